@@ -0,0 +1,48 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Monotonic arena: objects are carved out of geometrically growing blocks
+// and are never freed one by one; everything goes when the arena does.
+// Objects never move, so raw pointers into the arena stay valid.
+template <typename T>
+class Arena {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "arena objects are released without running destructors");
+
+public:
+    explicit Arena(size_t firstBlock = 64) : next_(firstBlock ? firstBlock : 1) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    T* make() {
+        if (used_ == cap_) grow();
+        return new (&blocks_.back()[used_++]) T();
+    }
+
+    size_t size() const { return size_ + used_; }
+
+private:
+    using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+    void grow() {
+        size_ += used_;
+        blocks_.emplace_back(new Slot[next_]);
+        cap_ = next_;
+        used_ = 0;
+        next_ *= 2;
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> blocks_;
+    size_t used_ = 0;   // slots taken in the last block
+    size_t cap_ = 0;    // slots in the last block
+    size_t size_ = 0;   // objects in all earlier blocks
+    size_t next_;
+};
+
+#endif
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "loadData.h"
+#include "LinearRegression.h"
+#include "LogisticRegression.h"
+#include "KNN.h"
+#include "DecisionTree.h"
+#include "GaussianNB.h"
+#include "Hyperparams.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Kernels.h"
+
+struct BenchOptions {
+    std::string csv = "adult_income_cleaned.csv";
+    int target = 13;
+    std::vector<size_t> sizes = {1000, 10000, 100000, 1000000, 10000000};
+    int warmup = 1;
+    int reps = 5;
+    double maxSeconds = 10.0;   // per case; at least one timed rep always runs
+    bool full = false;          // ignore the per-kernel row caps
+    std::string out = "bench_results.json";
+    std::string label = "current";
+    std::string compare;
+    double threshold = 0.10;
+    size_t threads = 0;         // 0 = hardware threads
+    bool f32 = true;            // also run every model on float rows
+};
+
+struct BenchResult {
+    std::string name;
+    std::string data;
+    size_t rows = 0;
+    int reps = 0;
+    double median = 0.0;
+    double p95 = 0.0;
+    double min = 0.0;
+    double rowsPerSec = 0.0;
+};
+
+static BenchOptions opts;
+static std::vector<BenchResult> results;
+
+// Quadratic or copy-heavy kernels would dominate the run at the top sizes
+static size_t rowCap(std::string name) {
+    if (opts.full) return std::numeric_limits<size_t>::max();
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, "_f32") == 0)
+        name.resize(name.size() - 4);
+    if (name == "predict_knn" || name == "predict_knn_index") return 10000;
+    if (name == "fit_tree") return 25000;
+    if (name == "fit_linear" || name == "loadData") return 1000000;
+    return std::numeric_limits<size_t>::max();
+}
+
+static double percentile(std::vector<double> v, double q) {
+    std::sort(v.begin(), v.end());
+    size_t idx = static_cast<size_t>(q * (v.size() - 1) + 0.5);
+    return v[std::min(idx, v.size() - 1)];
+}
+
+// Silences the loader's progress prints while timing
+struct MuteCout {
+    std::streambuf* saved;
+    std::ostringstream sink;
+    MuteCout() : saved(std::cout.rdbuf(sink.rdbuf())) {}
+    ~MuteCout() { std::cout.rdbuf(saved); }
+};
+
+static void measure(const std::string& name, const std::string& data,
+                    size_t datasetRows, size_t rows, const std::function<void()>& fn) {
+    // The dataset is at least as large as what one run touches, so a caller
+    // that passes 0 (e.g. after clearing dataset.X) cannot bypass the cap.
+    if (std::max(datasetRows, rows) > rowCap(name)) return;
+
+    for (int i = 0; i < opts.warmup; ++i) fn();
+
+    std::vector<double> times;
+    double spent = 0.0;
+    for (int i = 0; i < opts.reps; ++i) {
+        auto t0 = std::chrono::steady_clock::now();
+        fn();
+        auto t1 = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(t1 - t0).count());
+        spent += times.back();
+        if (spent > opts.maxSeconds) break;
+    }
+
+    BenchResult r;
+    r.name = name;
+    r.data = data;
+    r.rows = rows;
+    r.reps = times.size();
+    r.median = percentile(times, 0.5);
+    r.p95 = percentile(times, 0.95);
+    r.min = *std::min_element(times.begin(), times.end());
+    r.rowsPerSec = r.median > 0.0 ? rows / r.median : 0.0;
+    results.push_back(r);
+
+    std::printf("%-20s %-10s %10zu rows  median %10.6fs  p95 %10.6fs  %12.0f rows/s\n",
+                name.c_str(), data.c_str(), rows, r.median, r.p95, r.rowsPerSec);
+    std::fflush(stdout);
+}
+
+// Integer-valued features with few distinct levels, like the encoded census columns
+static void makeSynthetic(size_t n, size_t d, unsigned seed) {
+    std::mt19937 g(seed);
+    std::uniform_int_distribution<int> level(0, 63);
+    std::normal_distribution<double> noise(0.0, 8.0);
+    std::vector<double> w(d);
+    for (size_t j = 0; j < d; ++j) w[j] = (j % 3 == 0 ? 1.0 : -0.5) / (j + 1);
+
+    dataset.X.assign(n, std::vector<double>(d));
+    dataset.y.assign(n, 0);
+    dataset.headers.clear();
+    for (size_t j = 0; j <= d; ++j) dataset.headers.push_back("f" + std::to_string(j));
+
+    for (size_t i = 0; i < n; ++i) {
+        double score = noise(g);
+        for (size_t j = 0; j < d; ++j) {
+            dataset.X[i][j] = level(g);
+            score += w[j] * (dataset.X[i][j] - 31.5);
+        }
+        dataset.y[i] = score > 0.0 ? 1 : 0;
+    }
+    dataset.loaded = true;
+}
+
+static std::string writeSyntheticCsv(size_t n) {
+    std::string path = "/tmp/bench_synthetic_" + std::to_string(n) + ".csv";
+    std::ofstream f(path);
+    for (size_t j = 0; j < dataset.headers.size(); ++j)
+        f << (j ? "," : "") << dataset.headers[j];
+    f << "\n";
+    for (size_t i = 0; i < dataset.X.size(); ++i) {
+        for (double v : dataset.X[i]) f << v << ",";
+        f << (dataset.y[i] ? ">50K" : "<=50K") << "\n";
+    }
+    return path;
+}
+
+// Model quality for one scalar type, NaN where the kernel was skipped.
+struct Quality {
+    double rmse = NAN, logistic = NAN, knn = NAN, tree = NAN, gnb = NAN;
+};
+
+// Float results are recorded as "<kernel>_f32"; double keeps the plain
+// names, so older result files still compare. n is the full dataset size
+// the row caps apply to.
+template <typename T>
+static Quality benchModels(const std::string& data, size_t n, const Matrix<T>& X_train,
+                           const Matrix<T>& X_test, const std::string& suffix) {
+    const Hyperparams hp;
+    Quality q;
+    size_t nTrain = X_train.size();
+    size_t nTest = X_test.size();
+    bool base = suffix.empty();
+    std::vector<T> y_train_t(dataset.y_train.begin(), dataset.y_train.end());
+    std::vector<double> y_test_d(dataset.y_test.begin(), dataset.y_test.end());
+
+    LinearModelT<T> lin;
+    measure("fit_linear" + suffix, data, n, nTrain, [&] { lin = fit_linear(X_train, y_train_t, hp.lambda); });
+    if (!lin.weights.empty()) {
+        std::vector<T> pred;
+        measure("predict_linear" + suffix, data, n, nTest, [&] { pred = predict_linear(lin, X_test); });
+        std::vector<double> pred_d(pred.begin(), pred.end());
+        if (base) measure("computeRMSE", data, n, nTest, [&] { computeRMSE(y_test_d, pred_d); });
+        if (!pred.empty()) q.rmse = computeRMSE(y_test_d, pred_d);
+    }
+
+    LogisticModelT<T> logit;
+    measure("fit_logistic" + suffix, data, n, nTrain,
+            [&] { logit = fit_logistic(X_train, dataset.y_train, hp.lr, hp.epochs, hp.reg); });
+    if (!logit.weights.empty()) {
+        std::vector<int> pred;
+        measure("predict_logistic" + suffix, data, n, nTest, [&] { pred = predict_logistic(logit, X_test); });
+        if (base) {
+            measure("confusion_matrix", data, n, nTest, [&] { confusion_matrix(dataset.y_test, pred); });
+            measure("computeAccuracy", data, n, nTest, [&] { computeAccuracy(dataset.y_test, pred); });
+            measure("macroF1", data, n, nTest, [&] { macroF1(dataset.y_test, pred); });
+        }
+        if (!pred.empty()) q.logistic = computeAccuracy(dataset.y_test, pred);
+    }
+
+    KNNModelT<T> knn;
+    measure("fit_knn" + suffix, data, n, nTrain, [&] { knn = fit_knn(X_train, dataset.y_train, hp.k); });
+    {
+        std::vector<int> pred;
+        measure("predict_knn" + suffix, data, n, nTest, [&] { pred = predict_knn(knn, X_test); });
+        if (!pred.empty()) q.knn = computeAccuracy(dataset.y_test, pred);
+    }
+    if (base && !knn.X_train.empty() && n <= rowCap("predict_knn_index")) {
+        // The updatable index: scoring, and a refresh that erases the oldest
+        // 1% of the rows and inserts them again while another thread keeps
+        // scoring. Afterwards the index must agree with a model fitted on
+        // the rows it holds.
+        KNNIndexT<T> index(knn);
+        measure("predict_knn_index", data, n, nTest, [&] { index.predict(X_test); });
+        std::deque<std::pair<uint64_t, size_t>> live;
+        for (size_t i = 0; i < nTrain; ++i) live.emplace_back(i, i);
+        size_t churn = std::max<size_t>(1, nTrain / 100);
+        std::atomic<bool> stop(false);
+        Matrix<T> probe(X_test.begin(), X_test.begin() + std::min<size_t>(X_test.size(), 8));
+        std::thread reader([&] {
+            while (!stop.load()) index.predict(probe);
+        });
+        measure("knn_index_update", data, n, churn, [&] {
+            for (size_t i = 0; i < churn; ++i) {
+                auto oldest = live.front();
+                live.pop_front();
+                index.erase(oldest.first);
+                live.emplace_back(index.insert(X_train[oldest.second], dataset.y_train[oldest.second]),
+                                  oldest.second);
+            }
+        });
+        stop = true;
+        reader.join();
+
+        Matrix<T> heldX;
+        std::vector<int> heldY;
+        for (const auto& row : live) {
+            heldX.push_back(X_train[row.second]);
+            heldY.push_back(dataset.y_train[row.second]);
+        }
+        if (index.size() != live.size() ||
+            index.predict(X_test) != predict_knn(fit_knn(heldX, heldY, hp.k), X_test)) {
+            std::cerr << "KNNIndex disagrees with predict_knn after updates on " << data << "\n";
+            std::exit(1);
+        }
+    }
+    knn = KNNModelT<T>();
+
+    DecisionTreeModel tree;
+    measure("fit_tree" + suffix, data, n, nTrain, [&] { tree = fit_tree(X_train, dataset.y_train, hp.maxDepth); });
+    if (tree.root) {
+        std::vector<int> pred;
+        measure("predict_tree" + suffix, data, n, nTest, [&] { pred = predict_tree(tree, X_test); });
+        if (!pred.empty()) q.tree = computeAccuracy(dataset.y_test, pred);
+    }
+
+    GaussianNBModelT<T> gnb;
+    measure("fit_gnb" + suffix, data, n, nTrain, [&] { gnb = fit_gnb(X_train, dataset.y_train); });
+    if (!gnb.classes.empty()) {
+        std::vector<int> pred;
+        measure("predict_gnb" + suffix, data, n, nTest, [&] { pred = predict_gnb(gnb, X_test); });
+        if (!pred.empty()) q.gnb = computeAccuracy(dataset.y_test, pred);
+    }
+    return q;
+}
+
+static void printQuality(const std::string& data, size_t rows, const Quality& f64, const Quality& f32) {
+    std::printf("%-10s %10zu rows  f64 vs f32:  linear RMSE %.6f / %.6f", data.c_str(), rows,
+                f64.rmse, f32.rmse);
+    std::printf("  accuracy logistic %.4f / %.4f  knn %.4f / %.4f  tree %.4f / %.4f  gnb %.4f / %.4f\n",
+                f64.logistic, f32.logistic, f64.knn, f32.knn, f64.tree, f32.tree, f64.gnb, f32.gnb);
+    std::fflush(stdout);
+}
+
+// Weighted fits on the distinct training rows, named "<fit>_dedup"; rows
+// per second count the raw training rows each fit stands for.
+static void benchDedup(const std::string& data) {
+    const Hyperparams hp;
+    size_t n = dataset.X_train.size() + dataset.X_test.size();
+    size_t nTrain = dataset.X_train.size();
+    WeightedSet distinct;
+    measure("dedupRows", data, n, nTrain,
+            [&] { distinct = dedupRows(dataset.X_train, dataset.y_train); });
+    if (distinct.X.empty()) return;
+    std::printf("%-20s %-10s %10zu distinct of %zu training rows\n", "", data.c_str(),
+                distinct.X.size(), nTrain);
+
+    std::vector<double> y_d(distinct.y.begin(), distinct.y.end());
+    const std::vector<double>& w = distinct.weights;
+    measure("fit_linear_dedup", data, n, nTrain, [&] { fit_linear(distinct.X, y_d, w, hp.lambda); });
+    measure("fit_logistic_dedup", data, n, nTrain,
+            [&] { fit_logistic(distinct.X, distinct.y, w, hp.lr, hp.epochs, hp.reg); });
+    measure("fit_tree_dedup", data, n, nTrain, [&] { fit_tree(distinct.X, distinct.y, w, hp.maxDepth); });
+    measure("fit_gnb_dedup", data, n, nTrain, [&] { fit_gnb(distinct.X, distinct.y, w); });
+}
+
+// Double first, then the same split as float with the double rows released.
+static void benchBothScalars(const std::string& data) {
+    size_t rows = dataset.X_train.size() + dataset.X_test.size();
+    Quality f64 = benchModels<double>(data, rows, dataset.X_train, dataset.X_test, "");
+    if (!opts.f32) return;
+    Matrix<float> train = cast_matrix<float>(dataset.X_train);
+    Matrix<float> test = cast_matrix<float>(dataset.X_test);
+    Matrix<double>().swap(dataset.X_train);
+    Matrix<double>().swap(dataset.X_test);
+    Quality f32 = benchModels<float>(data, rows, train, test, "_f32");
+    printQuality(data, rows, f64, f32);
+}
+
+static void writeJson(const std::string& path) {
+    std::ofstream f(path);
+    f << "{\n";
+    f << "  \"label\": \"" << opts.label << "\",\n";
+    f << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+    f << "  \"threads\": " << num_threads() << ",\n";
+    f << "  \"isa\": \"" << kernels().name << "\",\n";
+    f << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        char buf[512];
+        std::snprintf(buf, sizeof(buf),
+                      "    {\"name\": \"%s\", \"data\": \"%s\", \"rows\": %zu, \"reps\": %d, "
+                      "\"median_s\": %.9g, \"p95_s\": %.9g, \"min_s\": %.9g, \"rows_per_s\": %.6g}",
+                      r.name.c_str(), r.data.c_str(), r.rows, r.reps,
+                      r.median, r.p95, r.min, r.rowsPerSec);
+        f << buf << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+}
+
+static std::string jsonField(const std::string& line, const std::string& key) {
+    std::string pat = "\"" + key + "\": ";
+    size_t p = line.find(pat);
+    if (p == std::string::npos) return "";
+    p += pat.size();
+    if (line[p] == '"') {
+        size_t e = line.find('"', p + 1);
+        return line.substr(p + 1, e - p - 1);
+    }
+    size_t e = line.find_first_of(",}", p);
+    return line.substr(p, e - p);
+}
+
+// Compares medians against a previous results file; returns the number of regressions
+static int compareWith(const std::string& path) {
+    std::ifstream f(path);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open baseline: " << path << "\n";
+        return 0;
+    }
+
+    int regressions = 0;
+    std::string line;
+    std::printf("\nComparison against %s (threshold %.0f%%):\n", path.c_str(), opts.threshold * 100);
+    while (std::getline(f, line)) {
+        std::string name = jsonField(line, "name");
+        if (name.empty()) continue;
+        std::string data = jsonField(line, "data");
+        size_t rows = std::strtoull(jsonField(line, "rows").c_str(), nullptr, 10);
+        double base = std::atof(jsonField(line, "median_s").c_str());
+
+        for (const BenchResult& r : results) {
+            if (r.name != name || r.data != data || r.rows != rows || base <= 0.0) continue;
+            double change = r.median / base - 1.0;
+            bool slow = change > opts.threshold;
+            regressions += slow;
+            std::printf("%-20s %-10s %10zu rows  %+7.1f%%%s\n", name.c_str(), data.c_str(),
+                        rows, change * 100.0, slow ? "  REGRESSION" : "");
+        }
+    }
+    return regressions;
+}
+
+static std::vector<size_t> parseSizes(const std::string& s) {
+    std::vector<size_t> out;
+    std::stringstream ss(s);
+    std::string tok;
+    while (std::getline(ss, tok, ','))
+        out.push_back(static_cast<size_t>(std::atof(tok.c_str())));
+    return out;
+}
+
+static void usage() {
+    std::cout << "Usage: bench [--data FILE] [--target COL] [--sizes 1e3,1e4,...]\n"
+                 "             [--warmup N] [--reps N] [--max-seconds S] [--full]\n"
+                 "             [--out FILE] [--label NAME] [--compare FILE] [--threshold F]\n"
+                 "             [--threads N] [--no-f32]\n";
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : ""; };
+        if (arg == "--data") opts.csv = next();
+        else if (arg == "--target") opts.target = std::atoi(next().c_str());
+        else if (arg == "--sizes") opts.sizes = parseSizes(next());
+        else if (arg == "--warmup") opts.warmup = std::atoi(next().c_str());
+        else if (arg == "--reps") opts.reps = std::max(1, std::atoi(next().c_str()));
+        else if (arg == "--max-seconds") opts.maxSeconds = std::atof(next().c_str());
+        else if (arg == "--full") opts.full = true;
+        else if (arg == "--out") opts.out = next();
+        else if (arg == "--label") opts.label = next();
+        else if (arg == "--compare") opts.compare = next();
+        else if (arg == "--threshold") opts.threshold = std::atof(next().c_str());
+        else if (arg == "--threads") opts.threads = std::strtoul(next().c_str(), nullptr, 10);
+        else if (arg == "--no-f32") opts.f32 = false;
+        else { usage(); return arg == "--help" ? 0 : 1; }
+    }
+    set_num_threads(opts.threads);
+    std::cout << "Kernels: " << kernels().name << ", threads: " << num_threads() << "\n";
+
+    // Real data
+    if (!opts.csv.empty()) {
+        {
+            MuteCout mute;
+            loadData(opts.csv, opts.target);
+        }
+        if (dataset.loaded) {
+            size_t n = dataset.X.size();
+            measure("loadData", "csv", n, n, [&] { MuteCout mute; loadData(opts.csv, opts.target); });
+            measure("splitDataset", "csv", n, n, [&] { splitDataset(0.8); });
+            benchDedup("csv");
+            benchBothScalars("csv");
+        }
+    }
+
+    // Synthetic scaling
+    for (size_t n : opts.sizes) {
+        makeSynthetic(n, 15, 42);
+        if (n <= rowCap("loadData")) {
+            std::string path = writeSyntheticCsv(n);
+            int target = static_cast<int>(dataset.X[0].size());
+            measure("loadData", "synthetic", n, n, [&] { MuteCout mute; loadData(path, target); });
+            // 1% samples: the whole file is still read, but only kept rows are parsed.
+            LoadSampling sample;
+            sample.rows = std::max<size_t>(1, n / 100);
+            measure("loadData_sample", "synthetic", n, n,
+                    [&] { MuteCout mute; loadData(path, target, sample); });
+            sample.stratified = true;
+            measure("loadData_stratified", "synthetic", n, n,
+                    [&] { MuteCout mute; loadData(path, target, sample); });
+            std::remove(path.c_str());
+            makeSynthetic(n, 15, 42);
+        }
+        measure("splitDataset", "synthetic", n, n, [&] { splitDataset(0.8); });
+        dataset.X.clear();
+        dataset.X.shrink_to_fit();
+        benchBothScalars("synthetic");
+        dataset = Dataset();
+    }
+
+    writeJson(opts.out);
+    std::cout << "Wrote " << results.size() << " results to " << opts.out << "\n";
+
+    if (!opts.compare.empty())
+        return compareWith(opts.compare) > 0 ? 2 : 0;
+    return 0;
+}
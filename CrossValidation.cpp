@@ -0,0 +1,279 @@
+#include "CrossValidation.h"
+#include "LinearRegression.h"
+#include "LogisticRegression.h"
+#include "KNN.h"
+#include "DecisionTree.h"
+#include "GaussianNB.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <numeric>
+
+// Builds the folds from a fold id per row, walking rows in `order`.
+static std::vector<FoldIndices> foldsFromAssignment(const std::vector<int>& assign,
+                                                    const std::vector<size_t>& order,
+                                                    int k) {
+    std::vector<FoldIndices> folds(k);
+    std::vector<size_t> testSize(k, 0);
+    for (int f : assign) testSize[f]++;
+    for (int f = 0; f < k; ++f) {
+        folds[f].test.reserve(testSize[f]);
+        folds[f].train.reserve(assign.size() - testSize[f]);
+    }
+
+    for (size_t r : order) {
+        for (int f = 0; f < k; ++f) {
+            if (assign[r] == f) folds[f].test.push_back(r);
+            else folds[f].train.push_back(r);
+        }
+    }
+    return folds;
+}
+
+std::vector<FoldIndices> kfold_indices(size_t n, int k, uint64_t seed) {
+    if (k < 2 || size_t(k) > n) return {};
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), size_t(0));
+    RngStream rng(seed);
+    deterministic_shuffle(order, rng);
+
+    std::vector<int> assign(n);
+    size_t pos = 0;
+    for (int f = 0; f < k; ++f) {
+        size_t size = n / k + (size_t(f) < n % k ? 1 : 0);
+        for (size_t i = 0; i < size; ++i) assign[order[pos++]] = f;
+    }
+    return foldsFromAssignment(assign, order, k);
+}
+
+std::vector<FoldIndices> stratified_kfold_indices(const std::vector<int>& y, int k,
+                                                  uint64_t seed) {
+    size_t n = y.size();
+    if (k < 2 || size_t(k) > n) return {};
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), size_t(0));
+    RngStream rng(seed);
+    deterministic_shuffle(order, rng);
+
+    // Stable sort by label keeps the shuffle within each class
+    std::vector<size_t> byClass = order;
+    std::stable_sort(byClass.begin(), byClass.end(),
+                     [&](size_t a, size_t b) { return y[a] < y[b]; });
+
+    // Continue the round-robin across class boundaries so small classes do
+    // not all land in fold 0
+    std::vector<int> assign(n);
+    for (size_t i = 0; i < n; ++i) assign[byClass[i]] = int(i % k);
+    return foldsFromAssignment(assign, order, k);
+}
+
+namespace {
+
+// Fold-invariant inputs, computed once before any fold is trained.
+struct SharedWork {
+    std::vector<double> y_d;        // y as regression target
+    TreeBins bins;                  // decision tree
+    std::vector<Scaler> scalers;    // per fold, from its training rows: linear, logistic, k-NN
+
+    const Scaler* scalerOrNull(size_t fold) const {
+        return fold < scalers.size() && scalers[fold].active() ? &scalers[fold] : nullptr;
+    }
+};
+
+std::vector<int> labelsOf(const std::vector<int>& y, const std::vector<size_t>& rows) {
+    std::vector<int> out;
+    out.reserve(rows.size());
+    for (size_t r : rows) out.push_back(y[r]);
+    return out;
+}
+
+void scoreClassifier(FoldScore& s, const std::vector<int>& y,
+                     const FoldIndices& fold, const std::vector<int>& y_pred) {
+    ConfusionMatrix cm = confusion_matrix(labelsOf(y, fold.test), y_pred);
+    s.accuracy = cm.accuracy();
+    s.macroF1 = cm.macroF1();
+}
+
+FoldScore evaluateFold(const std::string& algo, int index,
+                       const std::vector<std::vector<double>>& X,
+                       const std::vector<int>& y, const SharedWork& shared,
+                       const FoldIndices& fold, const Hyperparams& p) {
+    FoldScore s;
+    if (algo == "linear") {
+        LinearModel model;
+        std::vector<double> y_pred;
+        {
+            ScopedTimer timer("train.linear", &s.trainTime, index);
+            model = fit_linear(X, shared.y_d, fold.train, p.lambda, shared.scalerOrNull(index));
+        }
+        {
+            ScopedTimer timer("predict.linear", &s.predictTime, index);
+            y_pred = predict_linear(model, X, fold.test);
+        }
+        std::vector<double> y_true;
+        y_true.reserve(fold.test.size());
+        for (size_t r : fold.test) y_true.push_back(shared.y_d[r]);
+        s.rmse = computeRMSE(y_true, y_pred);
+    }
+    else if (algo == "logistic") {
+        LogisticModel model;
+        std::vector<int> y_pred;
+        {
+            ScopedTimer timer("train.logistic", &s.trainTime, index);
+            model = fit_logistic(X, y, fold.train, p.lr, p.epochs, p.reg, shared.scalerOrNull(index));
+        }
+        {
+            ScopedTimer timer("predict.logistic", &s.predictTime, index);
+            y_pred = predict_logistic(model, X, fold.test);
+        }
+        scoreClassifier(s, y, fold, y_pred);
+    }
+    else if (algo == "knn") {
+        // Lazy learner: nothing to train
+        std::vector<int> y_pred;
+        {
+            ScopedTimer timer("predict.knn", &s.predictTime, index);
+            y_pred = predict_knn(X, y, fold.train, fold.test, p.k,
+                                 shared.scalerOrNull(index));
+        }
+        scoreClassifier(s, y, fold, y_pred);
+    }
+    else if (algo == "tree") {
+        DecisionTreeModel model;
+        std::vector<int> y_pred;
+        {
+            ScopedTimer timer("train.tree", &s.trainTime, index);
+            model = fit_tree(X, y, fold.train, p.maxDepth, &shared.bins);
+        }
+        {
+            ScopedTimer timer("predict.tree", &s.predictTime, index);
+            y_pred = predict_tree(model, X, fold.test);
+        }
+        scoreClassifier(s, y, fold, y_pred);
+    }
+    else if (algo == "gnb") {
+        GaussianNBModel model;
+        std::vector<int> y_pred;
+        {
+            ScopedTimer timer("train.gnb", &s.trainTime, index);
+            model = fit_gnb(X, y, fold.train);
+        }
+        {
+            ScopedTimer timer("predict.gnb", &s.predictTime, index);
+            y_pred = predict_gnb(model, X, fold.test);
+        }
+        scoreClassifier(s, y, fold, y_pred);
+    }
+    return s;
+}
+
+MeanStd summarize(const std::vector<FoldScore>& folds, double FoldScore::*field) {
+    MeanStd m;
+    if (folds.empty()) return m;
+    for (const FoldScore& f : folds) m.mean += f.*field;
+    m.mean /= folds.size();
+    if (folds.size() > 1) {
+        double ss = 0.0;
+        for (const FoldScore& f : folds) ss += (f.*field - m.mean) * (f.*field - m.mean);
+        m.stddev = std::sqrt(ss / (folds.size() - 1));
+    }
+    return m;
+}
+
+bool uses(const std::vector<std::string>& algorithms, const char* name) {
+    return std::find(algorithms.begin(), algorithms.end(), name) != algorithms.end();
+}
+
+} // namespace
+
+std::vector<CVResult> cross_validate(const std::vector<std::vector<double>>& X,
+                                     const std::vector<int>& y,
+                                     const std::vector<std::string>& algorithms,
+                                     const CVConfig& config) {
+    PROFILE_SCOPE("cv");
+    std::vector<FoldIndices> folds = config.stratified
+        ? stratified_kfold_indices(y, config.folds, config.seed)
+        : kfold_indices(X.size(), config.folds, config.seed);
+
+    std::vector<CVResult> results(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        results[a].algorithm = algorithms[a];
+        results[a].regression = algorithms[a] == "linear";
+        results[a].folds.resize(folds.size());
+        if (folds.empty()) results[a].error = "need 2 <= folds <= rows";
+    }
+    if (folds.empty()) return results;
+
+    SharedWork shared;
+    {
+        PROFILE_SCOPE("cv.shared");
+        if (config.params.scale != SCALE_NONE) {
+            shared.scalers.resize(folds.size());
+            parallel_for(0, folds.size(), 1, [&](size_t lo, size_t hi) {
+                for (size_t f = lo; f < hi; ++f)
+                    shared.scalers[f] = make_scaler(X, folds[f].train, config.params.scale);
+            });
+        }
+        if (uses(algorithms, "linear")) shared.y_d.assign(y.begin(), y.end());
+        if (uses(algorithms, "tree")) shared.bins = bin_features(X);
+    }
+
+    ThreadPool& pool = shared_pool();
+    std::vector<std::vector<std::future<FoldScore>>> pending(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        for (size_t f = 0; f < folds.size(); ++f) {
+            const std::string& algo = algorithms[a];
+            const FoldIndices& fold = folds[f];
+            pending[a].push_back(pool.submit([&X, &y, &shared, &algo, &fold, &config, f]() {
+                return evaluateFold(algo, int(f), X, y, shared, fold, config.params);
+            }));
+        }
+    }
+
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        CVResult& r = results[a];
+        for (size_t f = 0; f < folds.size(); ++f) {
+            try {
+                r.folds[f] = pending[a][f].get();
+            }
+            catch (const std::exception& e) {
+                if (r.error.empty()) r.error = e.what();
+            }
+        }
+        r.accuracy = summarize(r.folds, &FoldScore::accuracy);
+        r.macroF1 = summarize(r.folds, &FoldScore::macroF1);
+        r.rmse = summarize(r.folds, &FoldScore::rmse);
+    }
+    return results;
+}
+
+void printCVResults(const std::vector<CVResult>& results, double wallTime) {
+    double serial = 0.0;
+    std::printf("\n%-10s %6s %12s %22s %22s %22s\n", "algorithm", "folds",
+                "train (s)", "accuracy", "macro-F1", "RMSE");
+    for (const CVResult& r : results) {
+        double train = 0.0;
+        for (const FoldScore& f : r.folds) {
+            train += f.trainTime;
+            serial += f.trainTime + f.predictTime;
+        }
+        if (!r.error.empty()) {
+            std::printf("%-10s failed: %s\n", r.algorithm.c_str(), r.error.c_str());
+            continue;
+        }
+        if (r.regression)
+            std::printf("%-10s %6zu %12.6f %22s %22s %10.6f +- %8.6f\n", r.algorithm.c_str(),
+                        r.folds.size(), train, "-", "-", r.rmse.mean, r.rmse.stddev);
+        else
+            std::printf("%-10s %6zu %12.6f %9.4f%% +- %7.4f%% %10.6f +- %8.6f %22s\n",
+                        r.algorithm.c_str(), r.folds.size(), train,
+                        r.accuracy.mean * 100.0, r.accuracy.stddev * 100.0,
+                        r.macroF1.mean, r.macroF1.stddev, "-");
+    }
+    std::printf("\nWall time: %.6f s (sum of fold times: %.6f s)\n", wallTime, serial);
+}
@@ -0,0 +1,68 @@
+#ifndef CROSSVALIDATION_H
+#define CROSSVALIDATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Hyperparams.h"
+
+// One fold as index views into the full dataset; rows are never copied.
+// Train rows keep the shuffled order, which matters for SGD.
+struct FoldIndices {
+    std::vector<size_t> train;
+    std::vector<size_t> test;
+};
+
+// Shuffles 0..n-1 with `seed` and deals it into k contiguous test blocks
+// whose sizes differ by at most one.
+std::vector<FoldIndices> kfold_indices(size_t n, int k, uint64_t seed);
+
+// Deals the rows of each class round-robin over the folds, so every fold
+// keeps the class proportions of y.
+std::vector<FoldIndices> stratified_kfold_indices(const std::vector<int>& y, int k,
+                                                  uint64_t seed);
+
+struct CVConfig {
+    int folds = 5;
+    bool stratified = false;
+    uint64_t seed = 42;
+    Hyperparams params;   // params.scale: each fold's scaler comes from its training rows
+};
+
+struct FoldScore {
+    double accuracy = 0.0;
+    double macroF1 = 0.0;
+    double rmse = 0.0;
+    double trainTime = 0.0;
+    double predictTime = 0.0;
+};
+
+struct MeanStd {
+    double mean = 0.0;
+    double stddev = 0.0;   // sample standard deviation over folds
+};
+
+struct CVResult {
+    std::string algorithm;
+    bool regression = false;
+    std::vector<FoldScore> folds;
+    MeanStd accuracy;
+    MeanStd macroF1;
+    MeanStd rmse;
+    std::string error;
+};
+
+// Trains and scores every (algorithm, fold) pair as its own task. Work that
+// does not depend on the fold (tree feature binning) is done once up front,
+// and each fold's scaler once for all algorithms; tasks share them
+// read-only.
+std::vector<CVResult> cross_validate(const std::vector<std::vector<double>>& X,
+                                     const std::vector<int>& y,
+                                     const std::vector<std::string>& algorithms,
+                                     const CVConfig& config);
+
+void printCVResults(const std::vector<CVResult>& results, double wallTime);
+
+#endif
@@ -1,80 +1,200 @@
 #include "DecisionTree.h"
+#include "Profiler.h"
+#include "Metrics.h"
+#include "Parallel.h"
 #include <cmath>
 #include <algorithm>
-#include <queue>
-#include <map>
-#include <set>
+#include <numeric>
 #include <limits>
 #include <iostream>
+#include <stdexcept>
 
-double entropy(const std::vector<int>& y) {
-    std::map<int,int> counts;
-    for (int label : y) counts[label]++;
-    
+// Entropy of a class histogram of total weight n. Counts are sample
+// weights summed in double, which stay exact for integer weights, so
+// unweighted fits see exactly the integer counts they always did.
+static double entropy(const double* counts, size_t numClasses, double n) {
     double H = 0.0;
-    int n = y.size();
-    for (auto& p : counts) {
-        double prob = double(p.second)/n;
+    for (size_t c = 0; c < numClasses; ++c) {
+        if (counts[c] == 0) continue;
+        double prob = counts[c]/n;
         H -= prob * std::log2(prob);
     }
     return H;
 }
 
-double infoGain(const std::vector<int>& y, const std::vector<int>& left, const std::vector<int>& right) {
-    double H = entropy(y);
-    double H_left = entropy(left);
-    double H_right = entropy(right);
-    return H - (left.size()/double(y.size()) * H_left + right.size()/double(y.size()) * H_right);
+template <typename T>
+TreeBins bin_features(const Matrix<T>& X) {
+    TreeBins bins;
+    if (X.empty()) return bins;
+    size_t numFeatures = X[0].size();
+    bins.values.resize(numFeatures);
+    bins.bin.resize(numFeatures);
+    for (size_t f = 0; f < numFeatures; ++f) {
+        std::vector<double>& values = bins.values[f];
+        values.reserve(X.size());
+        for (auto& row : X) values.push_back(row[f]);
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        values.shrink_to_fit();
+
+        std::vector<uint32_t>& bin = bins.bin[f];
+        bin.resize(X.size());
+        for (size_t i = 0; i < X.size(); ++i)
+            bin[i] = uint32_t(std::lower_bound(values.begin(), values.end(), X[i][f]) - values.begin());
+    }
+    return bins;
 }
 
-std::shared_ptr<TreeNode> buildTree(const std::vector<std::vector<double>>& X, 
-                                    const std::vector<int>& y, 
-                                    int depth, int maxDepth) {
-    auto node = std::make_shared<TreeNode>();
-    
+namespace {
+
+// Best threshold found so far; ties keep the earlier candidate.
+struct Split {
+    double gain = -1.0;
+    int feature = -1;
+    double threshold = 0.0;
+};
+
+// Buffers for sweeping one feature's thresholds.
+struct SplitScratch {
+    std::vector<double> hist, left, right;
+    std::vector<std::pair<uint32_t, size_t>> sorted;   // (bin, row)
+};
+
+// Rows are passed around as indices into X. A node owns the range
+// [lo, hi) of one shared index array and partitions it in place for its
+// children, and all split-search buffers are reused from node to node, so
+// growing a tree allocates nothing per node beyond the arena's blocks.
+template <typename T>
+struct TreeBuilder {
+    const Matrix<T>& X;
+    const std::vector<int>& y;
+    const TreeBins& bins;
+    int maxDepth;
+    std::vector<int> cls;   // dense class of each row, ascending by label
+    size_t numClasses = 0;
+    TreeArena& arena;
+    std::vector<double> weight;   // sample weight of each row
+
+    std::vector<size_t> order, spill;
+    std::vector<double> total;
+    SplitScratch scratch;
+
+    TreeNode* build(size_t lo, size_t hi, int depth);
+    void searchFeature(size_t f, const size_t* rows, size_t n, double H, double wn,
+                       SplitScratch& s, Split& best) const;
+};
+
+// Thresholds are swept in ascending order over a class histogram of the
+// node's rows, so each candidate costs O(classes) instead of a pass over
+// the rows.
+template <typename T>
+void TreeBuilder<T>::searchFeature(size_t f, const size_t* rows, size_t n, double H, double wn,
+                                SplitScratch& s, Split& best) const {
+    const std::vector<uint32_t>& bin = bins.bin[f];
+    const std::vector<double>& values = bins.values[f];
+    s.left.assign(numClasses, 0.0);
+    s.right.resize(numClasses);
+    double nl = 0;
+    size_t candidates = 0;
+
+    auto consider = [&](uint32_t b, const double* counts) {
+        for (size_t c = 0; c < numClasses; ++c) {
+            s.left[c] += counts[c];
+            nl += counts[c];
+        }
+        ++candidates;
+        double nr = wn - nl;
+        if (nr <= 0) return;
+        for (size_t c = 0; c < numClasses; ++c) s.right[c] = total[c] - s.left[c];
+
+        double gain = H - (nl/wn * entropy(s.left.data(), numClasses, nl) +
+                           nr/wn * entropy(s.right.data(), numClasses, nr));
+        if (gain > best.gain) {
+            best.gain = gain;
+            best.feature = int(f);
+            best.threshold = values[b];
+        }
+    };
+
+    if (values.size() <= n) {
+        s.hist.assign(values.size() * numClasses, 0.0);
+        for (size_t i = 0; i < n; ++i)
+            s.hist[bin[rows[i]] * numClasses + cls[rows[i]]] += weight[rows[i]];
+        for (uint32_t b = 0; b < values.size(); ++b) {
+            const double* counts = &s.hist[b * numClasses];
+            if (std::any_of(counts, counts + numClasses, [](double c) { return c > 0; }))
+                consider(b, counts);
+        }
+    } else {
+        // Few rows, many distinct values: sort the rows instead.
+        s.sorted.clear();
+        for (size_t i = 0; i < n; ++i) s.sorted.emplace_back(bin[rows[i]], rows[i]);
+        std::sort(s.sorted.begin(), s.sorted.end());
+        s.hist.assign(numClasses, 0.0);
+        for (size_t i = 0; i < s.sorted.size(); ++i) {
+            size_t r = s.sorted[i].second;
+            s.hist[cls[r]] += weight[r];
+            if (i + 1 == s.sorted.size() || s.sorted[i + 1].first != s.sorted[i].first) {
+                consider(s.sorted[i].first, s.hist.data());
+                std::fill(s.hist.begin(), s.hist.end(), 0.0);
+            }
+        }
+    }
+    PROFILE_COUNT("tree.thresholds", candidates);
+}
+
+// Nodes with at least this many rows search their features in parallel.
+const size_t kParallelSplitRows = 8192;
+
+template <typename T>
+TreeNode* TreeBuilder<T>::build(size_t lo, size_t hi, int depth) {
+    TreeNode* node = arena.make();
+    const size_t* rows = order.data() + lo;
+    size_t n = hi - lo;
+    // Every node keeps the label it would get as a leaf, so a tree grown
+    // to depth D truncated at d < D predicts exactly like one grown to d.
+    node->label = n ? y[rows[0]] : -1;
+
+    total.assign(numClasses, 0.0);
+    for (size_t i = 0; i < n; ++i) total[cls[rows[i]]] += weight[rows[i]];
+    size_t present = std::count_if(total.begin(), total.end(), [](double c) { return c > 0; });
+    double wn = std::accumulate(total.begin(), total.end(), 0.0);
+
     // Check stopping conditions
-    std::set<int> unique_labels(y.begin(), y.end());
-    if (unique_labels.size() == 1 || depth >= maxDepth) {
+    if (present <= 1 || depth >= maxDepth) {
         node->isLeaf = true;
-        node->label = y[0];
         return node;
     }
 
-    // Find best split
-    int bestFeature = -1;
-    double bestThreshold = 0.0;
-    double bestGain = -1.0;
-
-    int numFeatures = X[0].size();
-    for (int f = 0; f < numFeatures; ++f) {
-        std::vector<double> values;
-        for (auto& row : X) values.push_back(row[f]);
-        std::set<double> unique(values.begin(), values.end());
-
-        for (double threshold : unique) {
-            std::vector<int> left_labels, right_labels;
-            for (size_t i = 0; i < X.size(); ++i) {
-                if (X[i][f] <= threshold) 
-                    left_labels.push_back(y[i]);
-                else 
-                    right_labels.push_back(y[i]);
-            }
-            
-            if (left_labels.empty() || right_labels.empty()) continue;
-            
-            double gain = infoGain(y, left_labels, right_labels);
-            if (gain > bestGain) {
-                bestGain = gain;
-                bestFeature = f;
-                bestThreshold = threshold;
-            }
+    // Find best split. Per-feature winners are merged in feature order, so
+    // the parallel search picks exactly the split the serial one would.
+    Split best;
+    {
+        PROFILE_SCOPE_N("tree.split_search", depth);
+        PROFILE_COUNT_N("tree.split_rows", depth, n);
+        double H = entropy(total.data(), numClasses, wn);
+        size_t features = bins.values.size();
+        if (n >= kParallelSplitRows && features > 1) {
+            best = parallel_reduce(size_t(0), features, 1, Split(),
+                [&](size_t fLo, size_t fHi) {
+                    SplitScratch s;
+                    Split part;
+                    for (size_t f = fLo; f < fHi; ++f) searchFeature(f, rows, n, H, wn, s, part);
+                    return part;
+                },
+                [](Split& acc, const Split& part) {
+                    if (part.gain > acc.gain) acc = part;
+                });
+        } else {
+            for (size_t f = 0; f < features; ++f) searchFeature(f, rows, n, H, wn, scratch, best);
         }
     }
+    int bestFeature = best.feature;
+    double bestThreshold = best.threshold;
 
     // If no good split found, make it a leaf
     if (bestFeature == -1) {
         node->isLeaf = true;
-        node->label = y[0];
         return node;
     }
 
@@ -83,34 +203,93 @@ std::shared_ptr<TreeNode> buildTree(const std::vector<std::vector<double>>& X,
     node->threshold = bestThreshold;
     node->isNumeric = true;
 
-    // Actually split the data
-    std::vector<std::vector<double>> X_left, X_right;
-    std::vector<int> y_left, y_right;
-    for (size_t i = 0; i < X.size(); ++i) {
-        if (X[i][bestFeature] <= bestThreshold) {
-            X_left.push_back(X[i]);
-            y_left.push_back(y[i]);
-        } else {
-            X_right.push_back(X[i]);
-            y_right.push_back(y[i]);
-        }
+    // Actually split the rows in place, keeping their order: left rows
+    // are compacted forward, right rows parked in `spill` and copied back.
+    size_t mid = lo;
+    spill.clear();
+    for (size_t i = lo; i < hi; ++i) {
+        size_t r = order[i];
+        if (X[r][bestFeature] <= bestThreshold)
+            order[mid++] = r;
+        else
+            spill.push_back(r);
     }
+    std::copy(spill.begin(), spill.end(), order.begin() + mid);
 
     // Recursively build subtrees
-    node->left = buildTree(X_left, y_left, depth+1, maxDepth);
-    node->right = buildTree(X_right, y_right, depth+1, maxDepth);
+    node->left = build(lo, mid, depth+1);
+    node->right = build(mid, hi, depth+1);
 
     return node;
 }
 
-DecisionTreeModel fit_tree(const std::vector<std::vector<double>>& X, 
-                           const std::vector<int>& y, int maxDepth) {
+} // namespace
+
+// Grows a tree on the listed rows; `weights` (one per row of X) may be null
+// for unit weights.
+template <typename T>
+static DecisionTreeModel grow_tree(const Matrix<T>& X,
+                                   const std::vector<int>& y,
+                                   const std::vector<size_t>& rows,
+                                   int maxDepth, const TreeBins* bins,
+                                   const std::vector<double>* weights) {
+    TreeBins local;
+    if (!bins) {
+        local = bin_features(X);
+        bins = &local;
+    }
+
     DecisionTreeModel model;
-    model.root = buildTree(X, y, 0, maxDepth);
+    model.nodes = std::make_shared<TreeArena>();
+    TreeBuilder<T> builder{X, y, *bins, maxDepth, {}, 0, *model.nodes};
+    std::vector<int> labels;
+    for (size_t r : rows) labels.push_back(y[r]);
+    std::sort(labels.begin(), labels.end());
+    labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+    builder.numClasses = labels.size();
+    builder.cls.assign(X.size(), 0);
+    for (size_t r : rows)
+        builder.cls[r] = int(std::lower_bound(labels.begin(), labels.end(), y[r]) - labels.begin());
+
+    if (weights)
+        builder.weight = *weights;
+    else
+        builder.weight.assign(X.size(), 1.0);
+
+    builder.order = rows;
+    builder.spill.reserve(rows.size());
+    model.root = builder.build(0, rows.size(), 0);
+    model.features = X.empty() ? 0 : X[0].size();
     return model;
 }
 
-int predict_node(const std::shared_ptr<TreeNode>& node, const std::vector<double>& x) {
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X,
+                           const std::vector<int>& y,
+                           const std::vector<size_t>& rows,
+                           int maxDepth, const TreeBins* bins) {
+    return grow_tree(X, y, rows, maxDepth, bins, nullptr);
+}
+
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X, const std::vector<int>& y, int maxDepth) {
+    std::vector<size_t> rows(X.size());
+    std::iota(rows.begin(), rows.end(), size_t(0));
+    return fit_tree(X, y, rows, maxDepth);
+}
+
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X, const std::vector<int>& y,
+                           const std::vector<double>& weights, int maxDepth) {
+    if (weights.size() != X.size())
+        throw std::runtime_error("Expected one weight per row");
+    std::vector<size_t> rows(X.size());
+    std::iota(rows.begin(), rows.end(), size_t(0));
+    return grow_tree(X, y, rows, maxDepth, nullptr, &weights);
+}
+
+template <typename T>
+static int predict_node(const TreeNode* node, const std::vector<T>& x) {
     if (node->isLeaf) return node->label;
     
     if (x[node->featureIndex] <= node->threshold)
@@ -119,37 +298,67 @@ int predict_node(const std::shared_ptr<TreeNode>& node, const std::vector<double
         return predict_node(node->right, x);
 }
 
-std::vector<int> predict_tree(const DecisionTreeModel& model, const std::vector<std::vector<double>>& X) {
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X) {
+    PROFILE_SCOPE("score.tree");
+    PROFILE_COUNT("score.rows", X.size());
     std::vector<int> y_pred;
     for (auto& row : X) 
         y_pred.push_back(predict_node(model.root, row));
     return y_pred;
 }
 
+template <typename T>
+static int predict_truncated(const TreeNode* node, const std::vector<T>& x, int depthLeft) {
+    while (!node->isLeaf && depthLeft-- > 0)
+        node = (x[node->featureIndex] <= node->threshold ? node->left : node->right);
+    return node->label;
+}
+
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows, int maxDepth) {
+    PROFILE_SCOPE("score.tree");
+    PROFILE_COUNT("score.rows", rows.size());
+    std::vector<int> y_pred;
+    y_pred.reserve(rows.size());
+    for (size_t r : rows)
+        y_pred.push_back(predict_truncated(model.root, X[r], maxDepth));
+    return y_pred;
+}
+
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows) {
+    PROFILE_SCOPE("score.tree");
+    PROFILE_COUNT("score.rows", rows.size());
+    std::vector<int> y_pred;
+    y_pred.reserve(rows.size());
+    for (size_t r : rows)
+        y_pred.push_back(predict_node(model.root, X[r]));
+    return y_pred;
+}
+
+#define INSTANTIATE_TREE(T)                                                                 \
+    template TreeBins bin_features(const Matrix<T>&);                                       \
+    template DecisionTreeModel fit_tree(const Matrix<T>&, const std::vector<int>&, int);    \
+    template DecisionTreeModel fit_tree(const Matrix<T>&, const std::vector<int>&,          \
+                                        const std::vector<size_t>&, int, const TreeBins*);  \
+    template DecisionTreeModel fit_tree(const Matrix<T>&, const std::vector<int>&,          \
+                                        const std::vector<double>&, int);                   \
+    template std::vector<int> predict_tree(const DecisionTreeModel&, const Matrix<T>&);     \
+    template std::vector<int> predict_tree(const DecisionTreeModel&, const Matrix<T>&,      \
+                                           const std::vector<size_t>&);                     \
+    template std::vector<int> predict_tree(const DecisionTreeModel&, const Matrix<T>&,      \
+                                           const std::vector<size_t>&, int);
+
+INSTANTIATE_TREE(float)
+INSTANTIATE_TREE(double)
+
 double computeAccuracy_tree(const std::vector<int>& y_true, const std::vector<int>& y_pred) {
-    int correct = 0;
-    for (size_t i = 0; i < y_true.size(); ++i)
-        if (y_true[i] == y_pred[i]) correct++;
-    return double(correct)/y_true.size() * 100.0;
+    return confusion_matrix(y_true, y_pred).accuracy() * 100.0;
 }
 
 double macroF1_tree(const std::vector<int>& y_true, const std::vector<int>& y_pred) {
-    std::set<int> labels(y_true.begin(), y_true.end());
-    double f1sum = 0.0;
-    
-    for (int label : labels) {
-        int tp = 0, fp = 0, fn = 0;
-        for (size_t i = 0; i < y_true.size(); ++i) {
-            if (y_pred[i] == label && y_true[i] == label) tp++;
-            if (y_pred[i] == label && y_true[i] != label) fp++;
-            if (y_pred[i] != label && y_true[i] == label) fn++;
-        }
-        
-        double prec = tp + fp == 0 ? 0.0 : double(tp)/(tp+fp);
-        double rec = tp + fn == 0 ? 0.0 : double(tp)/(tp+fn);
-        double f1 = (prec+rec==0) ? 0.0 : 2*prec*rec/(prec+rec);
-        f1sum += f1;
-    }
-    
-    return f1sum/labels.size();
+    return confusion_matrix(y_true, y_pred).macroF1();
 }
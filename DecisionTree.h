@@ -1,10 +1,14 @@
 #ifndef DECISIONTREE_H
 #define DECISIONTREE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <memory>
-#include <map>
+
+#include "Arena.h"
+#include "Scalar.h"
 
 struct TreeNode {
     bool isLeaf;
@@ -12,23 +16,65 @@ struct TreeNode {
     int featureIndex;
     double threshold;
     bool isNumeric;
-    std::map<std::string, std::shared_ptr<TreeNode>> children;
-    std::shared_ptr<TreeNode> left;
-    std::shared_ptr<TreeNode> right;
+    TreeNode* left;
+    TreeNode* right;
     
     TreeNode() : isLeaf(false), label(-1), featureIndex(-1), 
-                 threshold(0.0), isNumeric(false) {}
+                 threshold(0.0), isNumeric(false), left(nullptr), right(nullptr) {}
 };
 
+using TreeArena = Arena<TreeNode>;
+
+// Nodes live in the model's arena and are freed together with it; copies
+// of a model share the arena.
 struct DecisionTreeModel {
-    std::shared_ptr<TreeNode> root;
+    std::shared_ptr<TreeArena> nodes;
+    TreeNode* root = nullptr;
+    size_t features = 0;   // columns of the training rows
 };
 
-DecisionTreeModel fit_tree(const std::vector<std::vector<double>>& X, 
-                           const std::vector<int>& y, int maxDepth = 10);
+// Split candidates of a feature matrix: values[f] holds the distinct
+// values of feature f in ascending order, bin[f][i] the rank of X[i][f].
+// Depends only on X, so one binning serves every tree fitted on it.
+struct TreeBins {
+    std::vector<std::vector<double>> values;
+    std::vector<std::vector<uint32_t>> bin;
+};
+
+// Instantiated for float and double rows, like the fits and scoring
+// below. Thresholds are stored as double either way; every float is
+// exactly representable, so a tree compares float rows exactly.
+template <typename T>
+TreeBins bin_features(const Matrix<T>& X);
+
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X, const std::vector<int>& y, int maxDepth = 10);
+
+// Fits on the listed rows of X only. `bins` must come from bin_features(X);
+// when null, X is binned here.
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X,
+                           const std::vector<int>& y,
+                           const std::vector<size_t>& rows,
+                           int maxDepth, const TreeBins* bins = nullptr);
+
+// Weighted fit: row i counts as weights[i] rows in every class histogram,
+// so a row repeated w times can be passed once with weight w.
+template <typename T>
+DecisionTreeModel fit_tree(const Matrix<T>& X, const std::vector<int>& y,
+                           const std::vector<double>& weights, int maxDepth = 10);
+
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X);
+
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows);
 
-std::vector<int> predict_tree(const DecisionTreeModel& model, 
-                              const std::vector<std::vector<double>>& X);
+// Scores as if the tree had been grown only to maxDepth.
+template <typename T>
+std::vector<int> predict_tree(const DecisionTreeModel& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows, int maxDepth);
 
 double computeAccuracy_tree(const std::vector<int>& y_true, 
                             const std::vector<int>& y_pred);
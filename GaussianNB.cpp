@@ -1,115 +1,250 @@
 #include "GaussianNB.h"
+#include "Profiler.h"
+#include "Metrics.h"
+#include "Parallel.h"
 #include <algorithm>
 #include <numeric>
 #include <iostream>
 #include <map>
 #include <cmath>
+#include <stdexcept>
 
-double gaussian_prob(double x, double mean, double var) {
-    if (var == 0) var = 1e-6;
-    double exponent = std::exp(-std::pow(x - mean, 2) / (2 * var));
-    return (1.0 / std::sqrt(2 * M_PI * var)) * exponent;
+// Per-class log-likelihood terms, computed once per predict call:
+//   log p(c | x) = bias[c] - sum_j invTwoVar[c][j] * (x_j - mean[c][j])^2
+// with bias[c] = log(prior) - 1/2 sum_j log(2 pi var). Scoring a row is then
+// one weighted squared distance per class instead of an exp and a log per
+// feature, and a far-off row no longer underflows every class to -inf.
+template <typename T>
+struct GnbScorer {
+    std::vector<T> bias;
+    Matrix<T> invTwoVar;
+};
+
+template <typename T>
+static GnbScorer<T> make_scorer(const GaussianNBModelT<T>& model) {
+    GnbScorer<T> sc;
+    sc.bias.resize(model.classes.size());
+    sc.invTwoVar.resize(model.classes.size());
+    for (size_t i = 0; i < model.classes.size(); ++i) {
+        double bias = std::log(model.priors[i]);
+        for (T v : model.variances[i]) {
+            double var = v == 0 ? 1e-6 : double(v);
+            bias -= 0.5 * std::log(2 * M_PI * var);
+            sc.invTwoVar[i].push_back(T(1.0 / (2 * var)));
+        }
+        sc.bias[i] = T(bias);
+    }
+    return sc;
 }
 
-GaussianNBModel fit_gnb(const std::vector<std::vector<double>>& X,
-                        const std::vector<int>& y) {
-    GaussianNBModel model;
-    std::map<int, std::vector<std::vector<double>>> class_samples;
-    int n_features = X[0].size();
-    
-    for (size_t i = 0; i < y.size(); ++i)
-        class_samples[y[i]].push_back(X[i]);
-    
-    model.classes.reserve(class_samples.size());
-    model.means.reserve(class_samples.size());
-    model.variances.reserve(class_samples.size());
-    model.priors.reserve(class_samples.size());
-    
-    for (auto& [cls, samples] : class_samples) {
-        model.classes.push_back(cls);
-        int n_samples = samples.size();
-        
-        std::vector<double> mean(n_features, 0.0);
-        std::vector<double> var(n_features, 0.0);
-        
-        for (int j = 0; j < n_features; ++j)
-            for (auto& sample : samples)
-                mean[j] += sample[j];
-        
-        for (int j = 0; j < n_features; ++j)
-            mean[j] /= n_samples;
-        
-        for (int j = 0; j < n_features; ++j)
-            for (auto& sample : samples)
-                var[j] += (sample[j] - mean[j]) * (sample[j] - mean[j]);
-        
-        for (int j = 0; j < n_features; ++j)
-            var[j] /= n_samples;
-        
-        model.means.push_back(mean);
-        model.variances.push_back(var);
-        model.priors.push_back(static_cast<double>(n_samples) / y.size());
+// Per-class running moments (count, mean, sum of squared deviations),
+// kept in double whatever the row type.
+struct ClassMoments {
+    std::vector<int> classes;
+    std::vector<double> counts;
+    std::vector<std::vector<double>> means;
+    std::vector<std::vector<double>> m2;
+
+    size_t slot(int cls, size_t n_features) {
+        for (size_t c = 0; c < classes.size(); ++c)
+            if (classes[c] == cls) return c;
+        classes.push_back(cls);
+        counts.push_back(0.0);
+        means.emplace_back(n_features, 0.0);
+        m2.emplace_back(n_features, 0.0);
+        return classes.size() - 1;
     }
-    
+};
+
+// Chan et al. pairwise update: folds b into a without revisiting samples.
+static void merge_moments(ClassMoments& a, const ClassMoments& b) {
+    for (size_t cb = 0; cb < b.classes.size(); ++cb) {
+        size_t ca = a.slot(b.classes[cb], b.means[cb].size());
+        double na = a.counts[ca], nb = b.counts[cb];
+        double n = na + nb;
+        if (nb == 0.0) continue;
+
+        for (size_t j = 0; j < b.means[cb].size(); ++j) {
+            double delta = b.means[cb][j] - a.means[ca][j];
+            a.means[ca][j] += delta * nb / n;
+            a.m2[ca][j] += b.m2[cb][j] + delta * delta * na * nb / n;
+        }
+        a.counts[ca] = n;
+    }
+}
+
+// Welford accumulation over rows[lo, hi) (rows lo..hi of X when `rows` is
+// null). With sample weights (West's update) row i counts weights[i] times;
+// a unit weight reproduces the unweighted update exactly.
+template <typename T>
+static ClassMoments accumulate_moments(const Matrix<T>& X,
+                                       const std::vector<int>& y,
+                                       const size_t* rows, const double* weights,
+                                       size_t lo, size_t hi) {
+    ClassMoments acc;
+    size_t n_features = X[rows ? rows[lo] : lo].size();
+
+    for (size_t k = lo; k < hi; ++k) {
+        size_t i = rows ? rows[k] : k;
+        double w = weights ? weights[i] : 1.0;
+        if (w == 0) continue;
+        size_t c = acc.slot(y[i], n_features);
+        double n = acc.counts[c] += w;
+        double* mean = acc.means[c].data();
+        double* m2 = acc.m2[c].data();
+        const T* x = X[i].data();
+
+        for (size_t j = 0; j < n_features; ++j) {
+            double delta = x[j] - mean[j];
+            mean[j] += delta * w / n;
+            m2[j] += w * delta * (x[j] - mean[j]);
+        }
+    }
+    return acc;
+}
+
+template <typename T>
+static void partial_fit_rows(GaussianNBModelT<T>& model,
+                             const Matrix<T>& X,
+                             const std::vector<int>& y,
+                             const size_t* rows, const double* weights, size_t n_rows) {
+    if (n_rows == 0) return;
+
+    ClassMoments total;
+    if (model.counts.size() == model.classes.size()) {
+        total.classes = model.classes;
+        total.counts = model.counts;
+        total.means = cast_matrix<double>(model.means);
+        total.m2 = cast_matrix<double>(model.variances);
+        for (size_t c = 0; c < total.classes.size(); ++c)
+            for (double& v : total.m2[c]) v *= total.counts[c];
+    }
+
+    PROFILE_SCOPE("gnb.fit");
+    const size_t grain = 4096;
+    ClassMoments batch = parallel_reduce(size_t(0), n_rows, grain, ClassMoments(),
+        [&](size_t lo, size_t hi) { return accumulate_moments(X, y, rows, weights, lo, hi); },
+        [](ClassMoments& acc, const ClassMoments& part) { merge_moments(acc, part); });
+    merge_moments(total, batch);
+
+    // Keep classes in ascending order so predictions break ties consistently
+    std::vector<size_t> order(total.classes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return total.classes[a] < total.classes[b]; });
+
+    double n_total = 0.0;
+    for (double n : total.counts) n_total += n;
+
+    model.classes.clear();
+    model.means.clear();
+    model.variances.clear();
+    model.priors.clear();
+    model.counts.clear();
+
+    for (size_t c : order) {
+        std::vector<double> var = total.m2[c];
+        for (double& v : var) v /= total.counts[c];
+
+        model.classes.push_back(total.classes[c]);
+        model.means.push_back(cast_vector<T>(total.means[c]));
+        model.variances.push_back(cast_vector<T>(var));
+        model.counts.push_back(total.counts[c]);
+        model.priors.push_back(total.counts[c] / n_total);
+    }
+}
+
+template <typename T>
+void partial_fit_gnb(GaussianNBModelT<T>& model, const Matrix<T>& X,
+                     const std::vector<int>& y) {
+    partial_fit_rows(model, X, y, nullptr, nullptr, X.size());
+}
+
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y) {
+    GaussianNBModelT<T> model;
+    partial_fit_gnb(model, X, y);
     return model;
 }
 
-std::vector<int> predict_gnb(const GaussianNBModel& model,
-                             const std::vector<std::vector<double>>& X) {
-    std::vector<int> y_pred;
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y,
+                            const std::vector<size_t>& rows) {
+    GaussianNBModelT<T> model;
+    partial_fit_rows(model, X, y, rows.data(), nullptr, rows.size());
+    return model;
+}
+
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y,
+                            const std::vector<double>& weights) {
+    if (weights.size() != X.size())
+        throw std::runtime_error("Expected one weight per row");
+    GaussianNBModelT<T> model;
+    partial_fit_rows(model, X, y, nullptr, weights.data(), X.size());
+    return model;
+}
+
+template <typename T>
+static int predict_row(const GaussianNBModelT<T>& model, const GnbScorer<T>& sc,
+                       const std::vector<T>& row) {
+    T best_prob = -1;
+    int best_class = model.classes[0];
     
-    for (auto& row : X) {
-        double best_prob = -1.0;
-        int best_class = model.classes[0];
+    for (size_t i = 0; i < model.classes.size(); ++i) {
+        T prob = sc.bias[i] - wsqdist_n(row.data(), model.means[i].data(),
+                                        sc.invTwoVar[i].data(), row.size());
         
-        for (size_t i = 0; i < model.classes.size(); ++i) {
-            double prob = std::log(model.priors[i]);
-            for (size_t j = 0; j < row.size(); ++j)
-                prob += std::log(gaussian_prob(row[j], model.means[i][j], 
-                                              model.variances[i][j]));
-            
-            if (i == 0 || prob > best_prob) {
-                best_prob = prob;
-                best_class = model.classes[i];
-            }
+        if (i == 0 || prob > best_prob) {
+            best_prob = prob;
+            best_class = model.classes[i];
         }
-        y_pred.push_back(best_class);
     }
+    return best_class;
+}
+
+template <typename T>
+std::vector<int> predict_gnb(const GaussianNBModelT<T>& model, const Matrix<T>& X) {
+    PROFILE_SCOPE("score.gnb");
+    PROFILE_COUNT("score.rows", X.size());
+    GnbScorer<T> sc = make_scorer(model);
+    std::vector<int> y_pred;
+    
+    for (auto& row : X)
+        y_pred.push_back(predict_row(model, sc, row));
     
     return y_pred;
 }
 
+template <typename T>
+std::vector<int> predict_gnb(const GaussianNBModelT<T>& model, const Matrix<T>& X,
+                             const std::vector<size_t>& rows) {
+    PROFILE_SCOPE("score.gnb");
+    PROFILE_COUNT("score.rows", rows.size());
+    GnbScorer<T> sc = make_scorer(model);
+    std::vector<int> y_pred;
+    y_pred.reserve(rows.size());
+    for (size_t r : rows)
+        y_pred.push_back(predict_row(model, sc, X[r]));
+    return y_pred;
+}
+
+#define INSTANTIATE_GNB(T)                                                                  \
+    template void partial_fit_gnb(GaussianNBModelT<T>&, const Matrix<T>&,                   \
+                                  const std::vector<int>&);                                 \
+    template GaussianNBModelT<T> fit_gnb(const Matrix<T>&, const std::vector<int>&);        \
+    template GaussianNBModelT<T> fit_gnb(const Matrix<T>&, const std::vector<int>&,         \
+                                         const std::vector<size_t>&);                       \
+    template GaussianNBModelT<T> fit_gnb(const Matrix<T>&, const std::vector<int>&,         \
+                                         const std::vector<double>&);                       \
+    template std::vector<int> predict_gnb(const GaussianNBModelT<T>&, const Matrix<T>&);    \
+    template std::vector<int> predict_gnb(const GaussianNBModelT<T>&, const Matrix<T>&,     \
+                                          const std::vector<size_t>&);
+
+INSTANTIATE_GNB(float)
+INSTANTIATE_GNB(double)
+
 double macroF1_gnb(const std::vector<int>& y_true,
                    const std::vector<int>& y_pred) {
-    std::map<int, int> tp, fp, fn;
-    std::vector<int> classes;
-    
-    for (auto& y : y_true)
-        if (std::find(classes.begin(), classes.end(), y) == classes.end())
-            classes.push_back(y);
-    
-    for (auto cls : classes) {
-        tp[cls] = 0;
-        fp[cls] = 0;
-        fn[cls] = 0;
-    }
-    
-    for (size_t i = 0; i < y_true.size(); ++i) {
-        if (y_true[i] == y_pred[i]) 
-            tp[y_true[i]]++;
-        else {
-            fp[y_pred[i]]++;
-            fn[y_true[i]]++;
-        }
-    }
-    
-    double f1_sum = 0.0;
-    for (auto cls : classes) {
-        double precision = tp[cls] + fp[cls] == 0 ? 0 : (double)tp[cls] / (tp[cls] + fp[cls]);
-        double recall = tp[cls] + fn[cls] == 0 ? 0 : (double)tp[cls] / (tp[cls] + fn[cls]);
-        double f1 = (precision + recall == 0) ? 0 : 2 * precision * recall / (precision + recall);
-        f1_sum += f1;
-    }
-    
-    return f1_sum / classes.size();
+    return confusion_matrix(y_true, y_pred).macroF1();
 }
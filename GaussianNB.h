@@ -1,22 +1,51 @@
 #ifndef GAUSSIANNB_H
 #define GAUSSIANNB_H
 
+#include <cstddef>
 #include <vector>
 #include <cmath>
 #include <map>
 
-struct GaussianNBModel {
+#include "Scalar.h"
+
+template <typename T>
+struct GaussianNBModelT {
     std::vector<int> classes;
-    std::vector<std::vector<double>> means;
-    std::vector<std::vector<double>> variances;
+    Matrix<T> means;
+    Matrix<T> variances;
     std::vector<double> priors;
+    std::vector<double> counts;  // samples seen per class, needed by partial_fit_gnb
 };
 
-GaussianNBModel fit_gnb(const std::vector<std::vector<double>>& X,
-                        const std::vector<int>& y);
+using GaussianNBModel = GaussianNBModelT<double>;
+
+// Instantiated for float and double rows; moments are accumulated in
+// double either way and rounded to T when stored.
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y);
+
+// Fits on the listed rows of X only, without copying them.
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y,
+                            const std::vector<size_t>& rows);
+
+// Weighted fit: row i contributes weights[i] samples to its class count,
+// mean and variance.
+template <typename T>
+GaussianNBModelT<T> fit_gnb(const Matrix<T>& X, const std::vector<int>& y,
+                            const std::vector<double>& weights);
+
+// Folds another batch into an existing model (empty model = fresh fit).
+template <typename T>
+void partial_fit_gnb(GaussianNBModelT<T>& model, const Matrix<T>& X,
+                     const std::vector<int>& y);
+
+template <typename T>
+std::vector<int> predict_gnb(const GaussianNBModelT<T>& model, const Matrix<T>& X);
 
-std::vector<int> predict_gnb(const GaussianNBModel& model,
-                             const std::vector<std::vector<double>>& X);
+template <typename T>
+std::vector<int> predict_gnb(const GaussianNBModelT<T>& model, const Matrix<T>& X,
+                             const std::vector<size_t>& rows);
 
 double macroF1_gnb(const std::vector<int>& y_true,
                    const std::vector<int>& y_pred);
@@ -0,0 +1,18 @@
+#ifndef HYPERPARAMS_H
+#define HYPERPARAMS_H
+
+#include "Scaler.h"
+
+// Training settings for every model, in one place. The defaults are the
+// values the menu and batch runs have always used.
+struct Hyperparams {
+    double lambda = 0.1;   // linear: L2 ridge strength
+    double lr = 0.01;      // logistic: SGD step size
+    int epochs = 100;      // logistic: passes over the training rows
+    double reg = 0.0;      // logistic: L2 weight decay
+    int k = 5;             // k-NN: neighbors voting
+    int maxDepth = 10;     // tree: depth limit
+    ScaleMethod scale = SCALE_NONE;   // feature scaling for linear, logistic, k-NN
+};
+
+#endif
@@ -1,76 +1,436 @@
 #include "KNN.h"
+#include "Profiler.h"
+#include "Parallel.h"
+#include "Metrics.h"
 #include <cmath>
 #include <algorithm>
+#include <atomic>
 #include <limits>
 #include <map>
+#include <stdexcept>
+#include <string>
 
-KNNModel fit_knn(const std::vector<std::vector<double>>& X,
-                 const std::vector<int>& y,
-                 int k) {
-    KNNModel model;
+template <typename T>
+KNNModelT<T> fit_knn(const Matrix<T>& X, const std::vector<int>& y,
+                     int k, const Scaler* scaler) {
+    KNNModelT<T> model;
     model.X_train = X;
     model.y_train = y;
     model.k = k;
+    if (scaler && scaler->active()) model.scaler = *scaler;
     return model;
 }
 
-double euclidean(const std::vector<double>& a, const std::vector<double>& b) {
-    double sum = 0.0;
-    for (size_t i = 0; i < a.size(); ++i)
-        sum += (a[i] - b[i]) * (a[i] - b[i]);
-    return std::sqrt(sum);
+// Squared distance, between scaled rows when scale2 is not empty: the
+// shift cancels, so only the squared scale is used, as per-feature weights.
+// Squared distances order the same as distances; no sqrt needed.
+template <typename T>
+static T sq_distance(const std::vector<T>& a, const std::vector<T>& b,
+                     const std::vector<T>& scale2) {
+    if (scale2.empty()) return sqdist_n(a.data(), b.data(), a.size());
+    return wsqdist_n(a.data(), b.data(), scale2.data(), a.size());
 }
 
-std::vector<int> predict_knn(const KNNModel& model,
-                             const std::vector<std::vector<double>>& X_test) {
-    std::vector<int> y_pred;
+// A candidate neighbor: squared distance, position among the training
+// rows (the row id in KNNIndex), label. Ties on distance go to the earlier training row, so every
+// path (served model, CV, tuning) picks the same neighbors.
+template <typename T>
+struct Neighbor {
+    T distance;
+    size_t index;
+    int label;
+
+    bool operator<(const Neighbor& o) const {
+        return distance < o.distance || (distance == o.distance && index < o.index);
+    }
+};
+
+// Squared scale factors: weights that make dot products of raw rows equal
+// those of scaled rows, up to the shift (which distances do not see).
+template <typename T>
+static std::vector<T> squared_scale(const Scaler* scaler) {
+    std::vector<T> w;
+    if (scaler && scaler->active())
+        for (double c : scaler->scale) w.push_back(T(c * c));
+    return w;
+}
+
+// Majority label; ties go to the smallest label.
+static int vote(const int* labels, size_t count) {
+    std::map<int, int> counts;
+    for (size_t i = 0; i < count; ++i)
+        counts[labels[i]]++;
     
-    for (const auto& x : X_test) {
-        std::vector<std::pair<double, int>> distances;
-        for (size_t i = 0; i < model.X_train.size(); ++i)
-            distances.emplace_back(euclidean(x, model.X_train[i]), model.y_train[i]);
-        
-        std::sort(distances.begin(), distances.end(),
-                  [](const auto& a, const auto& b) { return a.first < b.first; });
-        
-        std::map<int, int> counts;
-        for (int i = 0; i < model.k && i < (int)distances.size(); ++i)
-            counts[distances[i].second]++;
-        
-        int max_count = -1, pred = -1;
-        for (auto& p : counts) {
-            if (p.second > max_count) {
-                max_count = p.second;
-                pred = p.first;
-            }
+    int max_count = -1, pred = -1;
+    for (auto& p : counts) {
+        if (p.second > max_count) {
+            max_count = p.second;
+            pred = p.first;
         }
-        
-        y_pred.push_back(pred);
     }
+    return pred;
+}
+
+template <typename T>
+std::vector<int> predict_knn(const KNNModelT<T>& model, const Matrix<T>& X_test) {
+    PROFILE_SCOPE("score.knn");
+    PROFILE_COUNT("score.rows", X_test.size());
+    std::vector<int> y_pred(X_test.size());
+    std::vector<T> scale2 = squared_scale<T>(&model.scaler);
+    
+    // Queries are independent; each chunk reuses one distance buffer.
+    size_t count = std::min<size_t>(std::max(model.k, 0), model.X_train.size());
+    parallel_for(0, X_test.size(), 64, [&](size_t lo, size_t hi) {
+        std::vector<Neighbor<T>> distances(model.X_train.size());
+        std::vector<int> nearest(count);
+        for (size_t q = lo; q < hi; ++q) {
+            const std::vector<T>& x = X_test[q];
+            {
+                PROFILE_SCOPE("knn.distances");
+                for (size_t i = 0; i < model.X_train.size(); ++i)
+                    distances[i] = {sq_distance(x, model.X_train[i], scale2), i, model.y_train[i]};
+            }
+            PROFILE_COUNT("knn.distance_evals", model.X_train.size());
+            
+            PROFILE_SCOPE("knn.select");
+            std::partial_sort(distances.begin(), distances.begin() + count, distances.end());
+            for (size_t i = 0; i < count; ++i) nearest[i] = distances[i].label;
+            y_pred[q] = vote(nearest.data(), count);
+        }
+    });
     
     return y_pred;
 }
 
-double macroF1_knn(const std::vector<int>& y_true,
-                   const std::vector<int>& y_pred) {
-    int tp0 = 0, fp0 = 0, fn0 = 0;
-    int tp1 = 0, fp1 = 0, fn1 = 0;
-    
-    for (size_t i = 0; i < y_true.size(); ++i) {
-        if (y_true[i] == 0) {
-            if (y_pred[i] == 0) tp0++; 
-            else fn0++;
-        } else {
-            if (y_pred[i] == 1) tp1++; 
-            else fn1++;
+template <typename T>
+NeighborLists knn_neighbors(const Matrix<T>& X,
+                            const std::vector<int>& y,
+                            const std::vector<size_t>& trainRows,
+                            const std::vector<size_t>& testRows, int kmax,
+                            const Scaler* scaler) {
+    PROFILE_SCOPE("score.knn");
+    PROFILE_COUNT("score.rows", testRows.size());
+    NeighborLists lists;
+    lists.stride = std::min<size_t>(std::max(kmax, 0), trainRows.size());
+    lists.labels.resize(testRows.size() * lists.stride);
+    std::vector<T> w = squared_scale<T>(scaler);
+
+    parallel_for(0, testRows.size(), 64, [&](size_t lo, size_t hi) {
+        std::vector<Neighbor<T>> distances(trainRows.size());
+        for (size_t t = lo; t < hi; ++t) {
+            size_t q = testRows[t];
+            const std::vector<T>& x = X[q];
+            {
+                PROFILE_SCOPE("knn.distances");
+                for (size_t i = 0; i < trainRows.size(); ++i) {
+                    size_t r = trainRows[i];
+                    distances[i] = {sq_distance(x, X[r], w), i, y[r]};
+                }
+            }
+            PROFILE_COUNT("knn.distance_evals", trainRows.size());
+
+            PROFILE_SCOPE("knn.select");
+            auto nth = distances.begin() + lists.stride;
+            std::partial_sort(distances.begin(), nth, distances.end());
+            int* out = lists.labels.data() + t * lists.stride;
+            for (auto it = distances.begin(); it != nth; ++it)
+                *out++ = it->label;
+        }
+    });
+
+    return lists;
+}
+
+std::vector<int> vote_neighbors(const NeighborLists& lists, int k) {
+    std::vector<int> y_pred;
+    if (lists.stride == 0) return y_pred;
+    size_t rows = lists.labels.size() / lists.stride;
+    y_pred.reserve(rows);
+    size_t count = std::min<size_t>(std::max(k, 0), lists.stride);
+    for (size_t i = 0; i < rows; ++i)
+        y_pred.push_back(vote(&lists.labels[i * lists.stride], count));
+    return y_pred;
+}
+
+template <typename T>
+std::vector<int> predict_knn(const Matrix<T>& X,
+                             const std::vector<int>& y,
+                             const std::vector<size_t>& trainRows,
+                             const std::vector<size_t>& testRows, int k,
+                             const Scaler* scaler) {
+    return vote_neighbors(knn_neighbors(X, y, trainRows, testRows, k, scaler), k);
+}
+
+// Rows per tail segment: enough that a snapshot stays a short list, few
+// enough that compacting one is cheap.
+static const size_t kSegmentRows = 4096;
+
+// Erase stamp of a row no snapshot has dropped.
+static const uint64_t kLive = std::numeric_limits<uint64_t>::max();
+
+template <typename T>
+struct KNNIndexT<T>::Segment {
+    Segment(size_t features, size_t capacity)
+        : capacity(capacity), values(new T[capacity * features]), labels(new int[capacity]),
+          ids(new uint64_t[capacity]), erased(new std::atomic<uint64_t>[capacity]) {
+        for (size_t r = 0; r < capacity; ++r) erased[r].store(kLive, std::memory_order_relaxed);
+    }
+
+    // Rows are written once, past every published count, so readers of
+    // the published prefix never see a write.
+    const size_t capacity;
+    std::unique_ptr<T[]> values;   // row-major
+    std::unique_ptr<int[]> labels;
+    std::unique_ptr<uint64_t[]> ids;
+    // Version of the first snapshot without the row. Snapshots up to that
+    // version still see it, so erasing never copies anything.
+    std::unique_ptr<std::atomic<uint64_t>[]> erased;
+
+    // Writer-only, under writeLock_; readers go by the snapshot.
+    size_t rows = 0;
+    size_t dead = 0;
+    size_t position = 0;   // in the latest segment list
+};
+
+template <typename T>
+struct KNNIndexT<T>::Snapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const SegmentList> segments;   // all but the last are full
+    size_t tailRows = 0;                           // published rows of the last one
+    size_t live = 0;
+};
+
+// The next snapshot, built under writeLock_. It shares the segment list
+// with the published one until segments are added, merged or dropped,
+// and then copies it once.
+template <typename T>
+struct KNNIndexT<T>::Draft {
+    Snapshot next;
+    std::shared_ptr<SegmentList> list;
+
+    SegmentList& edit() {
+        if (!list) {
+            list = std::make_shared<SegmentList>(*next.segments);
+            next.segments = list;
         }
-        
-        if (y_true[i] == 0 && y_pred[i] == 1) fp0++;
-        if (y_true[i] == 1 && y_pred[i] == 0) fp1++;
+        return *list;
     }
-    
-    double f1_0 = tp0 == 0 ? 0.0 : 2.0*tp0 / (2*tp0 + fp0 + fn0);
-    double f1_1 = tp1 == 0 ? 0.0 : 2.0*tp1 / (2*tp1 + fp1 + fn1);
-    
-    return (f1_0 + f1_1) / 2.0;
+};
+
+template <typename T>
+KNNIndexT<T>::KNNIndexT(size_t features, int k, const Scaler* scaler)
+    : features_(features), k_(k) {
+    if (scaler && scaler->active()) {
+        if (scaler->scale.size() != features)
+            throw std::runtime_error("Scaler does not match the feature count");
+        scaler_ = *scaler;
+    }
+    scale2_ = squared_scale<T>(&scaler_);
+    auto empty = std::make_shared<Snapshot>();
+    empty->segments = std::make_shared<const SegmentList>();
+    current_ = std::move(empty);
+}
+
+template <typename T>
+KNNIndexT<T>::KNNIndexT(const KNNModelT<T>& model)
+    : KNNIndexT(model.X_train.empty() ? 0 : model.X_train[0].size(), model.k, &model.scaler) {
+    insert(model.X_train, model.y_train);
+}
+
+template <typename T>
+std::shared_ptr<const typename KNNIndexT<T>::Snapshot> KNNIndexT<T>::snapshot() const {
+    return std::atomic_load(&current_);
+}
+
+template <typename T>
+typename KNNIndexT<T>::Draft KNNIndexT<T>::draft() const {
+    Draft d;
+    d.next = *snapshot();
+    ++d.next.version;
+    return d;
+}
+
+template <typename T>
+void KNNIndexT<T>::publish(Draft& d) {
+    std::atomic_store(&current_, std::shared_ptr<const Snapshot>(
+                                     std::make_shared<Snapshot>(std::move(d.next))));
+}
+
+// Callers hold writeLock_ and own the draft until they publish it.
+template <typename T>
+uint64_t KNNIndexT<T>::append(Draft& d, const T* row, int label) {
+    const SegmentList& segments = *d.next.segments;
+    if (segments.empty() || segments.back()->rows == segments.back()->capacity) {
+        SegmentList& list = d.edit();
+        list.push_back(std::make_shared<Segment>(features_, kSegmentRows));
+        list.back()->position = list.size() - 1;
+    }
+    Segment& tail = *d.next.segments->back();
+    size_t r = tail.rows++;
+    std::copy(row, row + features_, tail.values.get() + r * features_);
+    tail.labels[r] = label;
+    uint64_t id = nextId_++;
+    tail.ids[r] = id;
+    where_[id] = {&tail, r};
+    d.next.tailRows = tail.rows;
+    ++d.next.live;
+    return id;
+}
+
+// Rewrites segment s without its dead rows, folding in the neighbours
+// whose live rows fit in the same kSegmentRows, into one segment sized to
+// exactly those rows (or none when no row is left). Every segment then
+// stays mostly full, so their number follows the live rows rather than
+// the history of updates. Older snapshots keep the old segments alive
+// until their readers finish.
+template <typename T>
+void KNNIndexT<T>::compact(Draft& d, size_t s) {
+    SegmentList& list = d.edit();
+    auto liveRows = [](const Segment& seg) { return seg.rows - seg.dead; };
+    size_t lo = s, hi = s + 1, total = liveRows(*list[s]);
+    while (lo > 0 && total + liveRows(*list[lo - 1]) <= kSegmentRows)
+        total += liveRows(*list[--lo]);
+    while (hi < list.size() && total + liveRows(*list[hi]) <= kSegmentRows)
+        total += liveRows(*list[hi++]);
+
+    std::shared_ptr<Segment> fresh;
+    if (total > 0) {
+        fresh = std::make_shared<Segment>(features_, total);
+        for (size_t i = lo; i < hi; ++i) {
+            const Segment& from = *list[i];
+            for (size_t r = 0; r < from.rows; ++r) {
+                if (from.erased[r].load(std::memory_order_relaxed) != kLive) continue;
+                size_t to = fresh->rows++;
+                std::copy(from.values.get() + r * features_, from.values.get() + (r + 1) * features_,
+                          fresh->values.get() + to * features_);
+                fresh->labels[to] = from.labels[r];
+                fresh->ids[to] = from.ids[r];
+                where_[from.ids[r]] = {fresh.get(), to};
+            }
+        }
+    }
+
+    list.erase(list.begin() + lo + (fresh ? 1 : 0), list.begin() + hi);
+    if (fresh) list[lo] = std::move(fresh);
+    for (size_t i = lo; i < list.size(); ++i) list[i]->position = i;
+    d.next.tailRows = list.empty() ? 0 : list.back()->rows;
+}
+
+template <typename T>
+uint64_t KNNIndexT<T>::insert(const std::vector<T>& row, int label) {
+    if (row.size() != features_)
+        throw std::runtime_error("Expected " + std::to_string(features_) + " features per row");
+    std::lock_guard<std::mutex> g(writeLock_);
+    Draft d = draft();
+    uint64_t id = append(d, row.data(), label);
+    publish(d);
+    return id;
+}
+
+template <typename T>
+std::vector<uint64_t> KNNIndexT<T>::insert(const Matrix<T>& rows, const std::vector<int>& labels) {
+    if (rows.size() != labels.size())
+        throw std::runtime_error("Expected one label per row");
+    for (const auto& row : rows)
+        if (row.size() != features_)
+            throw std::runtime_error("Expected " + std::to_string(features_) + " features per row");
+
+    std::lock_guard<std::mutex> g(writeLock_);
+    Draft d = draft();
+    std::vector<uint64_t> ids;
+    ids.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i)
+        ids.push_back(append(d, rows[i].data(), labels[i]));
+    publish(d);
+    return ids;
+}
+
+template <typename T>
+bool KNNIndexT<T>::erase(uint64_t id) {
+    std::lock_guard<std::mutex> g(writeLock_);
+    auto it = where_.find(id);
+    if (it == where_.end()) return false;
+    Segment& seg = *it->second.first;
+    size_t r = it->second.second;
+    where_.erase(it);
+
+    Draft d = draft();
+    seg.erased[r].store(d.next.version, std::memory_order_relaxed);
+    ++seg.dead;
+    --d.next.live;
+    if (2 * seg.dead >= seg.rows) compact(d, seg.position);
+    publish(d);
+    return true;
+}
+
+template <typename T>
+size_t KNNIndexT<T>::size() const {
+    return snapshot()->live;
+}
+
+template <typename T>
+std::vector<int> KNNIndexT<T>::predict(const Matrix<T>& X) const {
+    PROFILE_SCOPE("score.knn");
+    PROFILE_COUNT("score.rows", X.size());
+    for (const auto& x : X)
+        if (x.size() < features_)
+            throw std::runtime_error("Expected " + std::to_string(features_) + " features per row");
+
+    std::shared_ptr<const Snapshot> snap = snapshot();
+    const SegmentList& segments = *snap->segments;
+    size_t count = std::min<size_t>(std::max(k_, 0), snap->live);
+    std::vector<int> y_pred(X.size());
+
+    parallel_for(0, X.size(), 64, [&](size_t lo, size_t hi) {
+        // Ids order rows by age, so the older row wins a tie.
+        std::vector<Neighbor<T>> candidates;
+        candidates.reserve(snap->live);
+        std::vector<int> nearest(count);
+        for (size_t q = lo; q < hi; ++q) {
+            const T* x = X[q].data();
+            candidates.clear();
+            {
+                PROFILE_SCOPE("knn.distances");
+                for (size_t s = 0; s < segments.size(); ++s) {
+                    const Segment& seg = *segments[s];
+                    size_t rows = s + 1 == segments.size() ? snap->tailRows : seg.capacity;
+                    for (size_t r = 0; r < rows; ++r) {
+                        if (seg.erased[r].load(std::memory_order_relaxed) <= snap->version) continue;
+                        const T* row = seg.values.get() + r * features_;
+                        T d = scale2_.empty() ? sqdist_n(x, row, features_)
+                                              : wsqdist_n(x, row, scale2_.data(), features_);
+                        candidates.push_back({d, size_t(seg.ids[r]), seg.labels[r]});
+                    }
+                }
+            }
+            PROFILE_COUNT("knn.distance_evals", candidates.size());
+
+            PROFILE_SCOPE("knn.select");
+            std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+            for (size_t i = 0; i < count; ++i) nearest[i] = candidates[i].label;
+            y_pred[q] = vote(nearest.data(), count);
+        }
+    });
+
+    return y_pred;
+}
+
+#define INSTANTIATE_KNN(T)                                                                  \
+    template KNNModelT<T> fit_knn(const Matrix<T>&, const std::vector<int>&, int,           \
+                                  const Scaler*);                                           \
+    template std::vector<int> predict_knn(const KNNModelT<T>&, const Matrix<T>&);           \
+    template NeighborLists knn_neighbors(const Matrix<T>&, const std::vector<int>&,         \
+                                         const std::vector<size_t>&,                        \
+                                         const std::vector<size_t>&, int, const Scaler*);   \
+    template std::vector<int> predict_knn(const Matrix<T>&, const std::vector<int>&,        \
+                                          const std::vector<size_t>&,                       \
+                                          const std::vector<size_t>&, int, const Scaler*);  \
+    template class KNNIndexT<T>;
+
+INSTANTIATE_KNN(float)
+INSTANTIATE_KNN(double)
+
+double macroF1_knn(const std::vector<int>& y_true,
+                   const std::vector<int>& y_pred) {
+    return confusion_matrix(y_true, y_pred).macroF1();
 }
@@ -1,19 +1,119 @@
 #ifndef KNN_H
 #define KNN_H
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
-struct KNNModel {
-    int k;
-    std::vector<std::vector<double>> X_train;
+#include "Scalar.h"
+#include "Scaler.h"
+
+template <typename T>
+struct KNNModelT {
+    int k = 5;
+    Matrix<T> X_train;
     std::vector<int> y_train;
+    Scaler scaler;   // distances are taken between scaled rows; X_train stays raw
 };
 
-KNNModel fit_knn(const std::vector<std::vector<double>>& X_train, 
-                 const std::vector<int>& y_train, int k);
+using KNNModel = KNNModelT<double>;
+
+// Instantiated for float and double rows, like everything below.
+template <typename T>
+KNNModelT<T> fit_knn(const Matrix<T>& X_train, const std::vector<int>& y_train, int k,
+                     const Scaler* scaler = nullptr);
+
+template <typename T>
+std::vector<int> predict_knn(const KNNModelT<T>& model, const Matrix<T>& X_test);
+
+// Labels of the nearest training rows of each query, nearest first; query i
+// owns labels[i * stride, (i + 1) * stride). Voting over a prefix of length
+// k gives the k-NN prediction for any k <= stride.
+struct NeighborLists {
+    size_t stride = 0;
+    std::vector<int> labels;
+};
+
+// Neighbor lists of testRows of X among trainRows of the same X for up to
+// kmax neighbors. Distances are computed directly, never through the
+// |a|^2 + |b|^2 - 2 a.b expansion, which cancels badly in float; so these
+// are the neighbors a model fitted on trainRows would pick.
+template <typename T>
+NeighborLists knn_neighbors(const Matrix<T>& X,
+                            const std::vector<int>& y,
+                            const std::vector<size_t>& trainRows,
+                            const std::vector<size_t>& testRows, int kmax,
+                            const Scaler* scaler = nullptr);
+
+// Majority vote over the first k neighbors; ties go to the smallest label.
+std::vector<int> vote_neighbors(const NeighborLists& lists, int k);
+
+// Scores testRows of X against trainRows of the same X without building a
+// model: vote_neighbors(knn_neighbors(..., k), k).
+template <typename T>
+std::vector<int> predict_knn(const Matrix<T>& X,
+                             const std::vector<int>& y,
+                             const std::vector<size_t>& trainRows,
+                             const std::vector<size_t>& testRows, int k,
+                             const Scaler* scaler = nullptr);
+
+// A k-NN reference set that changes in place. Rows live in segments;
+// scoring runs against an immutable snapshot and every update publishes a
+// new one, so readers never wait for writers, and writers only wait for
+// each other. insert appends to the tail segment and erase stamps the row
+// with the first snapshot version that drops it, so neither copies more
+// than the snapshot header. A segment is compacted once half of it is
+// dead, together with the neighbours that fit alongside it, which the
+// deletes that caused it pay for. Ties between equal distances go to the
+// older row.
+template <typename T>
+class KNNIndexT {
+public:
+    KNNIndexT(size_t features, int k, const Scaler* scaler = nullptr);
+    explicit KNNIndexT(const KNNModelT<T>& model);
+
+    // Adds a row of exactly features() values; the id stays valid until it
+    // is erased.
+    uint64_t insert(const std::vector<T>& row, int label);
+    std::vector<uint64_t> insert(const Matrix<T>& rows, const std::vector<int>& labels);
+
+    // False when the id is unknown or already erased.
+    bool erase(uint64_t id);
+
+    // Live rows in the current snapshot.
+    size_t size() const;
+    size_t features() const { return features_; }
+    int k() const { return k_; }
+
+    std::vector<int> predict(const Matrix<T>& X) const;
+
+private:
+    struct Segment;
+    struct Snapshot;
+    struct Draft;
+    using SegmentList = std::vector<std::shared_ptr<Segment>>;
+
+    std::shared_ptr<const Snapshot> snapshot() const;
+    Draft draft() const;
+    void publish(Draft& draft);
+    uint64_t append(Draft& draft, const T* row, int label);
+    void compact(Draft& draft, size_t s);
+
+    size_t features_;
+    int k_;
+    Scaler scaler_;
+    std::vector<T> scale2_;
+
+    std::shared_ptr<const Snapshot> current_;   // atomic_load / atomic_store only
+    std::mutex writeLock_;
+    uint64_t nextId_ = 0;
+    std::unordered_map<uint64_t, std::pair<Segment*, size_t>> where_;
+};
 
-std::vector<int> predict_knn(const KNNModel& model, 
-                              const std::vector<std::vector<double>>& X_test);
+using KNNIndex = KNNIndexT<double>;
 
 double macroF1_knn(const std::vector<int>& y_true,
                    const std::vector<int>& y_pred);
@@ -0,0 +1,111 @@
+// Kernel bodies shared by every vector ISA variant. No include guard:
+// Kernels.cpp includes this once per target, each time inside its own
+// namespace and `#pragma GCC target` region.
+//
+// 64-byte GCC vector types are split by the compiler into whatever the
+// target offers (4 xmm, 2 ymm or 1 zmm), while the lane arithmetic, and so
+// the rounding, stays exactly that of the scalar reference.
+
+typedef double vf64 __attribute__((vector_size(64)));
+typedef float vf32 __attribute__((vector_size(64)));
+
+static inline vf64 load_f64(const double* p) {
+    vf64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline vf32 load_f32(const float* p) {
+    vf32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline double fold_f64(const vf64& acc) {
+    double lanes[8];
+    std::memcpy(lanes, &acc, sizeof(lanes));
+    return fold_lanes(lanes, 8);
+}
+
+static inline float fold_f32(const vf32& acc) {
+    float lanes[16];
+    std::memcpy(lanes, &acc, sizeof(lanes));
+    return fold_lanes(lanes, 16);
+}
+
+static double dot_f64(const double* a, const double* b, size_t n) {
+    vf64 acc = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) acc += load_f64(a + i) * load_f64(b + i);
+    double sum = fold_f64(acc);
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static float dot_f32(const float* a, const float* b, size_t n) {
+    vf32 acc = {};
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) acc += load_f32(a + i) * load_f32(b + i);
+    float sum = fold_f32(acc);
+    for (; i < n; ++i) sum += a[i] * b[i];
+    return sum;
+}
+
+static double sqdist_f64(const double* a, const double* b, size_t n) {
+    vf64 acc = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vf64 d = load_f64(a + i) - load_f64(b + i);
+        acc += d * d;
+    }
+    double sum = fold_f64(acc);
+    for (; i < n; ++i) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+static float sqdist_f32(const float* a, const float* b, size_t n) {
+    vf32 acc = {};
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        vf32 d = load_f32(a + i) - load_f32(b + i);
+        acc += d * d;
+    }
+    float sum = fold_f32(acc);
+    for (; i < n; ++i) sum += (a[i] - b[i]) * (a[i] - b[i]);
+    return sum;
+}
+
+static double wsqdist_f64(const double* a, const double* b, const double* w, size_t n) {
+    vf64 acc = {};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vf64 d = load_f64(a + i) - load_f64(b + i);
+        acc += load_f64(w + i) * (d * d);
+    }
+    double sum = fold_f64(acc);
+    for (; i < n; ++i) sum += w[i] * ((a[i] - b[i]) * (a[i] - b[i]));
+    return sum;
+}
+
+static float wsqdist_f32(const float* a, const float* b, const float* w, size_t n) {
+    vf32 acc = {};
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        vf32 d = load_f32(a + i) - load_f32(b + i);
+        acc += load_f32(w + i) * (d * d);
+    }
+    float sum = fold_f32(acc);
+    for (; i < n; ++i) sum += w[i] * ((a[i] - b[i]) * (a[i] - b[i]));
+    return sum;
+}
+
+static void axpy_f64(size_t n, double alpha, const double* x, double* y) {
+    vf64 va;
+    for (int l = 0; l < 8; ++l) va[l] = alpha;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vf64 v = load_f64(y + i) + va * load_f64(x + i);
+        std::memcpy(y + i, &v, sizeof(v));
+    }
+    for (; i < n; ++i) y[i] += alpha * x[i];
+}
@@ -0,0 +1,199 @@
+#include "Kernels.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Halving fold of the lane accumulators; the same code finishes every
+// variant, so only the lane sums themselves are ISA specific.
+template <typename T>
+static inline T fold_lanes(T* lanes, size_t count) {
+    for (size_t w = count / 2; w > 0; w /= 2)
+        for (size_t l = 0; l < w; ++l) lanes[l] += lanes[l + w];
+    return lanes[0];
+}
+
+// Scalar reference: the canonical order spelled out with plain arrays.
+namespace isa_scalar {
+
+template <typename T, size_t L, typename Term>
+static T reduce(size_t n, Term term) {
+    T acc[L] = {};
+    size_t i = 0;
+    for (; i + L <= n; i += L)
+        for (size_t l = 0; l < L; ++l) acc[l] += term(i + l);
+    T sum = fold_lanes(acc, L);
+    for (; i < n; ++i) sum += term(i);
+    return sum;
+}
+
+static double dot_f64(const double* a, const double* b, size_t n) {
+    return reduce<double, 8>(n, [&](size_t i) { return a[i] * b[i]; });
+}
+
+static float dot_f32(const float* a, const float* b, size_t n) {
+    return reduce<float, 16>(n, [&](size_t i) { return a[i] * b[i]; });
+}
+
+static double sqdist_f64(const double* a, const double* b, size_t n) {
+    return reduce<double, 8>(n, [&](size_t i) { return (a[i] - b[i]) * (a[i] - b[i]); });
+}
+
+static float sqdist_f32(const float* a, const float* b, size_t n) {
+    return reduce<float, 16>(n, [&](size_t i) { return (a[i] - b[i]) * (a[i] - b[i]); });
+}
+
+static double wsqdist_f64(const double* a, const double* b, const double* w, size_t n) {
+    return reduce<double, 8>(n, [&](size_t i) { return w[i] * ((a[i] - b[i]) * (a[i] - b[i])); });
+}
+
+static float wsqdist_f32(const float* a, const float* b, const float* w, size_t n) {
+    return reduce<float, 16>(n, [&](size_t i) { return w[i] * ((a[i] - b[i]) * (a[i] - b[i])); });
+}
+
+static void axpy_f64(size_t n, double alpha, const double* x, double* y) {
+    for (size_t i = 0; i < n; ++i) y[i] += alpha * x[i];
+}
+
+const KernelTable table = {ISA_SCALAR, "scalar", dot_f64, dot_f32, sqdist_f64, sqdist_f32,
+                           wsqdist_f64, wsqdist_f32, axpy_f64};
+
+} // namespace isa_scalar
+
+#define KERNEL_TABLE(isa, name)                                                          \
+    const KernelTable table = {isa, name, dot_f64, dot_f32, sqdist_f64, sqdist_f32,     \
+                               wsqdist_f64, wsqdist_f32, axpy_f64};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+
+// The Makefile builds with -ffp-contract=off, so the avx512 variant (whose
+// target implies FMA) never fuses a multiply and an add and changes the
+// rounding. The 64-byte vector helpers are static and inlined, so the
+// psABI warning about returning them in registers does not apply.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+namespace isa_sse2 {
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#include "KernelBody.h"
+#pragma GCC pop_options
+KERNEL_TABLE(ISA_SSE2, "sse2")
+} // namespace isa_sse2
+
+namespace isa_avx2 {
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include "KernelBody.h"
+#pragma GCC pop_options
+KERNEL_TABLE(ISA_AVX2, "avx2")
+} // namespace isa_avx2
+
+namespace isa_avx512 {
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#include "KernelBody.h"
+#pragma GCC pop_options
+KERNEL_TABLE(ISA_AVX512, "avx512")
+} // namespace isa_avx512
+
+#endif
+
+size_t kernel_variants(const KernelTable** out, size_t max) {
+    size_t count = 0;
+    auto add = [&](const KernelTable& t) {
+        if (count < max) out[count] = &t;
+        ++count;
+    };
+    add(isa_scalar::table);
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) add(isa_sse2::table);
+    if (__builtin_cpu_supports("avx2")) add(isa_avx2::table);
+    if (__builtin_cpu_supports("avx512f")) add(isa_avx512::table);
+#endif
+    return count;
+}
+
+static const KernelTable& select_kernels() {
+    const KernelTable* variants[8];
+    size_t count = std::min<size_t>(kernel_variants(variants, 8), 8);
+    const KernelTable* best = variants[count - 1];
+
+    const char* forced = std::getenv("ML_ISA");
+    if (forced && *forced) {
+        for (size_t i = 0; i < count; ++i)
+            if (std::string(forced) == variants[i]->name) return *variants[i];
+        std::fprintf(stderr, "ML_ISA=%s is not available here; using %s\n", forced, best->name);
+    }
+    return *best;
+}
+
+const KernelTable& kernels() {
+    static const KernelTable& active = select_kernels();
+    return active;
+}
+
+// Bitwise comparison, so signed zeros and NaN payloads count too.
+template <typename T>
+static bool same_bits(T a, T b) {
+    return std::memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+bool kernel_selftest() {
+    const KernelTable* variants[8];
+    size_t count = std::min<size_t>(kernel_variants(variants, 8), 8);
+    const KernelTable& ref = isa_scalar::table;
+    const size_t maxLen = 4099, pad = 4;
+
+    // Values span several orders of magnitude so reordered sums would show.
+    RngStream rng(2024);
+    auto fill = [&](std::vector<double>& v) {
+        for (double& x : v) x = (rng.uniform() - 0.5) * std::ldexp(1.0, int(rng.below(40)) - 20);
+    };
+    std::vector<double> a(maxLen + pad), b(maxLen + pad), w(maxLen + pad);
+    fill(a);
+    fill(b);
+    for (double& x : w) x = rng.uniform();
+    std::vector<float> af(a.begin(), a.end()), bf(b.begin(), b.end()), wf(w.begin(), w.end());
+
+    std::vector<size_t> lengths;
+    for (size_t n = 0; n <= 70; ++n) lengths.push_back(n);
+    for (size_t n : {127, 128, 129, 1000, 1023, 4096, 4099}) lengths.push_back(n);
+
+    std::printf("Active kernels: %s\n", kernels().name);
+    bool allOk = true;
+    for (size_t v = 0; v < count; ++v) {
+        const KernelTable& k = *variants[v];
+        size_t checks = 0, failures = 0;
+        for (size_t n : lengths) {
+            for (size_t off = 0; off < pad; ++off) {
+                const double *pa = &a[off], *pb = &b[(off * 3) % pad], *pw = &w[off];
+                const float *fa = &af[off], *fb = &bf[(off * 3) % pad], *fw = &wf[off];
+                bool ok = same_bits(k.dot_f64(pa, pb, n), ref.dot_f64(pa, pb, n)) &&
+                          same_bits(k.dot_f32(fa, fb, n), ref.dot_f32(fa, fb, n)) &&
+                          same_bits(k.sqdist_f64(pa, pb, n), ref.sqdist_f64(pa, pb, n)) &&
+                          same_bits(k.sqdist_f32(fa, fb, n), ref.sqdist_f32(fa, fb, n)) &&
+                          same_bits(k.wsqdist_f64(pa, pb, pw, n), ref.wsqdist_f64(pa, pb, pw, n)) &&
+                          same_bits(k.wsqdist_f32(fa, fb, fw, n), ref.wsqdist_f32(fa, fb, fw, n));
+
+                std::vector<double> y1(pb, pb + n), y2(pb, pb + n);
+                k.axpy_f64(n, pw[0], pa, y1.data());
+                ref.axpy_f64(n, pw[0], pa, y2.data());
+                ok = ok && std::memcmp(y1.data(), y2.data(), n * sizeof(double)) == 0;
+
+                ++checks;
+                failures += !ok;
+            }
+        }
+        std::printf("  %-8s %zu cases  %s\n", k.name, checks,
+                    failures ? "MISMATCH" : "ok");
+        allOk = allOk && failures == 0;
+    }
+    return allOk;
+}
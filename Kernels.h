@@ -0,0 +1,45 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+
+// Hot numeric kernels, compiled once per instruction set and picked once
+// at startup from CPUID. Every variant reduces in the same fixed order
+// (64 bytes of lanes: 8 doubles or 16 floats, folded by halves, then the
+// tail left to right), so all paths return bit-identical results and a
+// binary is reproducible across a mixed fleet. ML_ISA=scalar|sse2|avx2|
+// avx512 forces a path, falling back to the best supported one.
+enum KernelIsa {
+    ISA_SCALAR = 0,
+    ISA_SSE2 = 1,
+    ISA_AVX2 = 2,
+    ISA_AVX512 = 3,
+};
+
+struct KernelTable {
+    KernelIsa isa;
+    const char* name;
+    double (*dot_f64)(const double* a, const double* b, size_t n);
+    float (*dot_f32)(const float* a, const float* b, size_t n);
+    double (*sqdist_f64)(const double* a, const double* b, size_t n);
+    float (*sqdist_f32)(const float* a, const float* b, size_t n);
+    // sum w[i] * (a[i] - b[i])^2
+    double (*wsqdist_f64)(const double* a, const double* b, const double* w, size_t n);
+    float (*wsqdist_f32)(const float* a, const float* b, const float* w, size_t n);
+    // y[i] += alpha * x[i]
+    void (*axpy_f64)(size_t n, double alpha, const double* x, double* y);
+};
+
+// The active table; selected on first use.
+const KernelTable& kernels();
+
+// Every variant compiled into this binary and supported by this CPU,
+// scalar reference first.
+size_t kernel_variants(const KernelTable** out, size_t max);
+
+// Checks every variant against the scalar reference on random inputs of
+// many lengths and alignments. Prints one line per variant; true when all
+// match bit for bit.
+bool kernel_selftest();
+
+#endif
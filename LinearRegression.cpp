@@ -1,39 +1,12 @@
 #include "LinearRegression.h"
+#include "Profiler.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Kernels.h"
 #include <cmath>
 #include <stdexcept>
 #include <iostream>
 
-std::vector<std::vector<double>> transpose(const std::vector<std::vector<double>>& X) {
-    if (X.empty()) return {};
-    size_t rows = X.size();
-    size_t cols = X[0].size();
-
-    std::vector<std::vector<double>> T(cols, std::vector<double>(rows));
-    for (size_t i = 0; i < rows; i++)
-        for (size_t j = 0; j < cols; j++)
-            T[j][i] = X[i][j];
-
-    return T;
-}
-
-std::vector<std::vector<double>> matmul(const std::vector<std::vector<double>>& A,
-                                        const std::vector<std::vector<double>>& B) {
-    if (A.empty() || B.empty()) return {};
-
-    size_t n = A.size();
-    size_t m = A[0].size();
-    size_t p = B[0].size();
-
-    std::vector<std::vector<double>> C(n, std::vector<double>(p, 0.0));
-
-    for (size_t i = 0; i < n; i++)
-        for (size_t k = 0; k < m; k++)
-            for (size_t j = 0; j < p; j++)
-                C[i][j] += A[i][k] * B[k][j];
-
-    return C;
-}
-
 std::vector<std::vector<double>> addLambda(const std::vector<std::vector<double>>& XTX,
                                            double lambda) {
     std::vector<std::vector<double>> A = XTX;
@@ -72,44 +45,146 @@ std::vector<double> solveLinearSystem(std::vector<std::vector<double>> A,
     return x;
 }
 
-LinearModel fit_linear(const std::vector<std::vector<double>>& X,
-                       const std::vector<double>& y,
-                       double lambda) {
-    LinearModel model;
+// Upper triangle of X^T X and X^T y for one chunk of rows, flat.
+struct GramPart {
+    std::vector<double> xtx, xty;
+};
 
-    size_t n = X.size();
-    size_t d = X[0].size();
+// X^T X and X^T y over rows[0..n) of X (all rows when `rows` is null),
+// accumulated row by row so no augmented copy of X is made. Row i is
+// counted weights[i] times when weights are given. Chunks of
+// rows are summed in parallel and merged in chunk order, so the result
+// does not depend on the thread count. Sums are double for any row type.
+template <typename T>
+static LinearGram gram_rows(const Matrix<T>& X,
+                            const std::vector<T>& y,
+                            const size_t* rows, const double* weights, size_t n,
+                            const Scaler* scaler) {
+    if (n == 0) throw std::runtime_error("No training rows");
 
-    std::vector<std::vector<double>> Xb(n, std::vector<double>(d + 1, 1.0));
-    for (size_t i = 0; i < n; i++)
-        for (size_t j = 0; j < d; j++)
-            Xb[i][j] = X[i][j];
+    size_t d = X[rows ? rows[0] : 0].size();
+    size_t m = d + 1;
+    LinearGram gram;
+    if (scaler && scaler->active()) gram.scaler = *scaler;
+    const Scaler& sc = gram.scaler;
 
-    auto X_T = transpose(Xb);
-    auto XTX = matmul(X_T, Xb);
+    PROFILE_SCOPE("linear.gram");
+    PROFILE_COUNT("linear.rows", n);
+    const size_t grain = 4096;
+    GramPart total = parallel_reduce(size_t(0), n, grain, GramPart(),
+        [&](size_t lo, size_t hi) {
+            GramPart part{std::vector<double>(m * m, 0.0), std::vector<double>(m, 0.0)};
+            std::vector<double> xb(m, 1.0);
+            for (size_t k = lo; k < hi; k++) {
+                size_t r = rows ? rows[k] : k;
+                if (sc.active())
+                    for (size_t j = 0; j < d; j++) xb[j] = sc.apply(j, X[r][j]);
+                else
+                    for (size_t j = 0; j < d; j++) xb[j] = X[r][j];
+                // Rank-1 update of the upper triangle, one row at a time.
+                double w = weights ? weights[r] : 1.0;
+                for (size_t i = 0; i < m; i++) {
+                    double wx = w * xb[i];
+                    kernels().axpy_f64(m - i, wx, &xb[i], &part.xtx[i * m + i]);
+                    part.xty[i] += wx * y[r];
+                }
+            }
+            return part;
+        },
+        [](GramPart& acc, const GramPart& part) {
+            if (acc.xtx.empty()) {
+                acc = part;
+                return;
+            }
+            kernels().axpy_f64(acc.xtx.size(), 1.0, part.xtx.data(), acc.xtx.data());
+            kernels().axpy_f64(acc.xty.size(), 1.0, part.xty.data(), acc.xty.data());
+        });
 
-    std::vector<double> XTy_vec(d + 1, 0.0);
+    gram.XTX.assign(m, std::vector<double>(m, 0.0));
+    for (size_t i = 0; i < m; i++)
+        for (size_t j = i; j < m; j++)
+            gram.XTX[i][j] = total.xtx[i * m + j];
+    gram.XTy = total.xty;
     for (size_t i = 0; i < d + 1; i++)
-        for (size_t j = 0; j < n; j++)
-            XTy_vec[i] += X_T[i][j] * y[j];
+        for (size_t j = 0; j < i; j++)
+            gram.XTX[i][j] = gram.XTX[j][i];
+    return gram;
+}
 
-    auto A = XTX;
+template <typename T>
+LinearGram linear_gram(const Matrix<T>& X,
+                       const std::vector<T>& y,
+                       const std::vector<size_t>& rows,
+                       const Scaler* scaler) {
+    return gram_rows(X, y, rows.data(), nullptr, rows.size(), scaler);
+}
+
+LinearModel fit_linear(const LinearGram& gram, double lambda) {
+    LinearModel model;
+    auto A = gram.XTX;
     for (size_t i = 1; i < A.size(); i++)
         A[i][i] += lambda;
 
-    model.weights = solveLinearSystem(A, XTy_vec);
+    PROFILE_SCOPE("linear.solve");
+    model.weights = solveLinearSystem(A, gram.XTy);
+
+    // w'.((x - s) * c) + b' = (w' * c).x + (b' - sum w' * c * s)
+    if (gram.scaler.active()) {
+        size_t d = model.weights.size() - 1;
+        for (size_t j = 0; j < d; j++) {
+            model.weights[j] *= gram.scaler.scale[j];
+            model.weights[d] -= model.weights[j] * gram.scaler.shift[j];
+        }
+    }
     return model;
 }
 
-std::vector<double> predict_linear(const LinearModel& model,
-                                   const std::vector<std::vector<double>>& X) {
+template <typename T>
+static LinearModelT<T> round_model(const LinearModel& model) {
+    LinearModelT<T> out;
+    out.weights = cast_vector<T>(model.weights);
+    out.bias = T(model.bias);
+    return out;
+}
+
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           double lambda, const Scaler* scaler) {
+    PROFILE_SCOPE("linear.fit");
+    return round_model<T>(fit_linear(gram_rows(X, y, nullptr, nullptr, X.size(), scaler), lambda));
+}
+
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           const std::vector<double>& weights,
+                           double lambda, const Scaler* scaler) {
+    if (weights.size() != X.size())
+        throw std::runtime_error("Expected one weight per row");
+    PROFILE_SCOPE("linear.fit");
+    return round_model<T>(fit_linear(gram_rows(X, y, nullptr, weights.data(), X.size(), scaler),
+                                     lambda));
+}
+
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           const std::vector<size_t>& rows,
+                           double lambda, const Scaler* scaler) {
+    PROFILE_SCOPE("linear.fit");
+    return round_model<T>(fit_linear(linear_gram(X, y, rows, scaler), lambda));
+}
+
+template <typename T>
+std::vector<T> predict_linear(const LinearModelT<T>& model, const Matrix<T>& X) {
     size_t n = X.size();
-    size_t d = X[0].size();
 
-    std::vector<double> preds(n, 0.0);
+    PROFILE_SCOPE("score.linear");
+    PROFILE_COUNT("score.rows", n);
+    std::vector<T> preds(n, T(0));
+    if (n == 0) return preds;
+    size_t d = X[0].size();
 
     for (size_t i = 0; i < n; i++) {
-        double y = model.weights[d];
+        T y = model.weights[d];
         for (size_t j = 0; j < d; j++)
             y += model.weights[j] * X[i][j];
         preds[i] = y;
@@ -118,13 +193,69 @@ std::vector<double> predict_linear(const LinearModel& model,
     return preds;
 }
 
-double computeRMSE(const std::vector<double>& y_true,
-                   const std::vector<double>& y_pred) {
-    size_t n = y_true.size();
-    double sum = 0.0;
+template <typename T>
+std::vector<T> predict_linear(const LinearModelT<T>& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows) {
+    PROFILE_SCOPE("score.linear");
+    PROFILE_COUNT("score.rows", rows.size());
+    std::vector<T> preds(rows.size(), T(0));
+    if (rows.empty()) return preds;
+    size_t d = X[rows[0]].size();
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        const std::vector<T>& x = X[rows[i]];
+        T y = model.weights[d];
+        for (size_t j = 0; j < d; j++)
+            y += model.weights[j] * x[j];
+        preds[i] = y;
+    }
 
-    for (size_t i = 0; i < n; i++)
-        sum += (y_true[i] - y_pred[i]) * (y_true[i] - y_pred[i]);
+    return preds;
+}
+
+#define INSTANTIATE_LINEAR(T)                                                               \
+    template LinearGram linear_gram(const Matrix<T>&, const std::vector<T>&,                \
+                                    const std::vector<size_t>&, const Scaler*);             \
+    template LinearModelT<T> fit_linear(const Matrix<T>&, const std::vector<T>&, double,    \
+                                        const Scaler*);                                     \
+    template LinearModelT<T> fit_linear(const Matrix<T>&, const std::vector<T>&,            \
+                                        const std::vector<size_t>&, double, const Scaler*); \
+    template LinearModelT<T> fit_linear(const Matrix<T>&, const std::vector<T>&,            \
+                                        const std::vector<double>&, double, const Scaler*); \
+    template std::vector<T> predict_linear(const LinearModelT<T>&, const Matrix<T>&);       \
+    template std::vector<T> predict_linear(const LinearModelT<T>&, const Matrix<T>&,        \
+                                           const std::vector<size_t>&);
+
+INSTANTIATE_LINEAR(float)
+INSTANTIATE_LINEAR(double)
 
-    return std::sqrt(sum / n);
+LinearModel fit_linear(const CsrMatrix& X, const std::vector<double>& y,
+                       double lambda) {
+    if (X.rows() == 0) throw std::runtime_error("No training rows");
+    PROFILE_SCOPE("linear.fit");
+    PROFILE_COUNT("linear.rows", X.rows());
+
+    LinearGram gram;
+    {
+        PROFILE_SCOPE("linear.gram");
+        size_t d = X.cols + 1;
+        std::vector<double> G = csr_gram(X, y, gram.XTy);
+        gram.XTX.resize(d);
+        for (size_t i = 0; i < d; i++)
+            gram.XTX[i].assign(G.begin() + i * d, G.begin() + (i + 1) * d);
+    }
+    return fit_linear(gram, lambda);
+}
+
+std::vector<double> predict_linear(const LinearModel& model, const CsrMatrix& X) {
+    PROFILE_SCOPE("score.linear");
+    PROFILE_COUNT("score.rows", X.rows());
+    return csr_gemv(X, model.weights, model.weights[X.cols]);
+}
+
+double computeRMSE(const std::vector<double>& y_true,
+                   const std::vector<double>& y_pred) {
+    RegressionStats stats;
+    accumulate(stats, y_true, y_pred);
+    return stats.rmse();
 }
@@ -1,19 +1,69 @@
 #ifndef LINEARREGRESSION_H
 #define LINEARREGRESSION_H
 
+#include <cstddef>
 #include <vector>
 
-struct LinearModel {
-    std::vector<double> weights;
-    double bias;
+#include "Scalar.h"
+#include "Scaler.h"
+#include "Sparse.h"
+
+template <typename T>
+struct LinearModelT {
+    std::vector<T> weights;
+    T bias = 0;
 };
 
-LinearModel fit_linear(const std::vector<std::vector<double>>& X,
-                       const std::vector<double>& y,
+using LinearModel = LinearModelT<double>;
+
+// Dense fits and scoring are instantiated for float and double rows; the
+// normal equations are built and solved in double either way.
+// With a scaler the normal equations are built on scaled rows (so lambda
+// penalizes scaled weights) and the solution is folded back: the returned
+// model always scores raw rows.
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           double lambda = 0.0, const Scaler* scaler = nullptr);
+
+// Fits on the listed rows of X only, without copying them.
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           const std::vector<size_t>& rows,
+                           double lambda, const Scaler* scaler = nullptr);
+
+// Weighted least squares: row i counts weights[i] times in X^T X and X^T y.
+template <typename T>
+LinearModelT<T> fit_linear(const Matrix<T>& X, const std::vector<T>& y,
+                           const std::vector<double>& weights,
+                           double lambda, const Scaler* scaler = nullptr);
+
+// Normal equations of a row subset. Solving them is cheap next to building
+// them, so one gram serves a whole lambda path.
+struct LinearGram {
+    std::vector<std::vector<double>> XTX;   // (d+1) x (d+1), intercept last
+    std::vector<double> XTy;
+    Scaler scaler;                          // space the rows were taken in
+};
+
+template <typename T>
+LinearGram linear_gram(const Matrix<T>& X, const std::vector<T>& y,
+                       const std::vector<size_t>& rows,
+                       const Scaler* scaler = nullptr);
+
+LinearModel fit_linear(const LinearGram& gram, double lambda);
+
+template <typename T>
+std::vector<T> predict_linear(const LinearModelT<T>& model, const Matrix<T>& X);
+
+template <typename T>
+std::vector<T> predict_linear(const LinearModelT<T>& model, const Matrix<T>& X,
+                              const std::vector<size_t>& rows);
+
+// Sparse rows: X^T X is accumulated from each row's non-zeros only.
+LinearModel fit_linear(const CsrMatrix& X, const std::vector<double>& y,
                        double lambda = 0.0);
 
-std::vector<double> predict_linear(const LinearModel& model,
-                                   const std::vector<std::vector<double>>& X);
+std::vector<double> predict_linear(const LinearModel& model, const CsrMatrix& X);
 
 double computeRMSE(const std::vector<double>& y_true,
                    const std::vector<double>& y_pred);
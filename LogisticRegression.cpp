@@ -1,12 +1,21 @@
 #include "LogisticRegression.h"
+#include "Profiler.h"
+#include "Metrics.h"
 #include <cmath>
 #include <numeric>
 #include <algorithm>
+#include <stdexcept>
 
 double sigmoid(double z) {
     return 1.0 / (1.0 + std::exp(-z));
 }
 
+// sigmoid evaluated in T, so float SGD never leaves single precision.
+template <typename T>
+static T logistic(T z) {
+    return T(1) / (T(1) + std::exp(-z));
+}
+
 double dot(const std::vector<double>& a, const std::vector<double>& b) {
     double sum = 0.0;
     for (size_t i = 0; i < a.size(); ++i)
@@ -14,71 +23,212 @@ double dot(const std::vector<double>& a, const std::vector<double>& b) {
     return sum;
 }
 
-LogisticModel fit_logistic(const std::vector<std::vector<double>>& X,
-                           const std::vector<int>& y,
-                           double lr, int epochs, double reg) {
-    size_t n_samples = X.size();
-    size_t n_features = X[0].size();
+// SGD over rows[0..n) of X in the given order (all rows when `rows` is null),
+// starting from `init` when given and from zero otherwise. With a scaler,
+// each row is scaled as it is visited and the weights live in scaled space
+// until they are folded back at the end. With sample weights, each row's
+// loss gradient is scaled by its weight (the L2 decay is not), so a row of
+// weight w pulls like w copies would in one step.
+template <typename T>
+static LogisticModelT<T> fit_logistic_rows(const Matrix<T>& X,
+                                           const std::vector<int>& y,
+                                           const size_t* rows, const double* sampleWeights,
+                                           size_t n_samples,
+                                           double lr, int epochs, double reg,
+                                           const LogisticModelT<T>* init, const Scaler* scaler) {
+    size_t n_features = X[rows ? rows[0] : 0].size();
+    bool scaled = scaler && scaler->active();
+    const T rate = T(lr), decay = T(reg);
     
-    LogisticModel model;
-    model.weights.assign(n_features, 0.0);
-    model.bias = 0.0;
+    LogisticModelT<T> model;
+    if (init) {
+        model = *init;
+        // w.x + b = (w / c).((x - s) * c) + (b + w.s)
+        if (scaled) {
+            for (size_t j = 0; j < n_features; ++j) {
+                model.bias += model.weights[j] * T(scaler->shift[j]);
+                model.weights[j] /= T(scaler->scale[j]);
+            }
+        }
+    } else {
+        model.weights.assign(n_features, T(0));
+        model.bias = 0;
+    }
     
+    PROFILE_SCOPE("logistic.fit");
+    std::vector<T> xs(scaled ? n_features : 0);
     for (int epoch = 0; epoch < epochs; ++epoch) {
-        for (size_t i = 0; i < n_samples; ++i) {
-            double z = dot(model.weights, X[i]) + model.bias;
-            double pred = sigmoid(z);
-            double error = pred - y[i];
+        PROFILE_SCOPE("logistic.epoch");
+        for (size_t k = 0; k < n_samples; ++k) {
+            size_t i = rows ? rows[k] : k;
+            const T* x = X[i].data();
+            if (scaled) {
+                for (size_t j = 0; j < n_features; ++j) xs[j] = T(scaler->apply(j, X[i][j]));
+                x = xs.data();
+            }
+            T z = dot_n(model.weights.data(), x, n_features) + model.bias;
+            T pred = logistic(z);
+            T error = pred - T(y[i]);
+            if (sampleWeights) error *= T(sampleWeights[i]);
             
             for (size_t j = 0; j < n_features; ++j)
-                model.weights[j] -= lr * (error * X[i][j] + reg * model.weights[j]);
+                model.weights[j] -= rate * (error * x[j] + decay * model.weights[j]);
             
-            model.bias -= lr * error;
+            model.bias -= rate * error;
+        }
+    }
+    PROFILE_COUNT("logistic.gradient_rows", uint64_t(epochs) * n_samples);
+
+    if (scaled) {
+        for (size_t j = 0; j < n_features; ++j) {
+            model.weights[j] *= T(scaler->scale[j]);
+            model.bias -= model.weights[j] * T(scaler->shift[j]);
         }
     }
     
     return model;
 }
 
-double predict_proba(const LogisticModel& model, const std::vector<double>& x) {
-    return sigmoid(dot(model.weights, x) + model.bias);
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               double lr, int epochs, double reg, const Scaler* scaler) {
+    return fit_logistic_rows<T>(X, y, nullptr, nullptr, X.size(), lr, epochs, reg, nullptr, scaler);
+}
+
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<double>& weights,
+                               double lr, int epochs, double reg, const Scaler* scaler) {
+    if (weights.size() != X.size())
+        throw std::runtime_error("Expected one weight per row");
+    return fit_logistic_rows<T>(X, y, nullptr, weights.data(), X.size(), lr, epochs, reg,
+                                nullptr, scaler);
 }
 
-std::vector<int> predict_logistic(const LogisticModel& model,
-                                  const std::vector<std::vector<double>>& X) {
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<size_t>& rows,
+                               double lr, int epochs, double reg, const Scaler* scaler) {
+    return fit_logistic_rows<T>(X, y, rows.data(), nullptr, rows.size(), lr, epochs, reg, nullptr,
+                                scaler);
+}
+
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<size_t>& rows,
+                               double lr, int epochs, double reg,
+                               const LogisticModelT<T>& init, const Scaler* scaler) {
+    return fit_logistic_rows<T>(X, y, rows.data(), nullptr, rows.size(), lr, epochs, reg, &init,
+                                scaler);
+}
+
+LogisticModel fit_logistic(const CsrMatrix& X, const std::vector<int>& y,
+                           double lr, int epochs, double reg) {
+    size_t n_samples = X.rows();
+    std::vector<double> v(X.cols, 0.0);
+    double s = 1.0;   // weights = s * v
+    double bias = 0.0;
+    double decay = 1.0 - lr * reg;
+
+    PROFILE_SCOPE("logistic.fit");
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        PROFILE_SCOPE("logistic.epoch");
+        for (size_t i = 0; i < n_samples; ++i) {
+            double z = s * sparse_dot(X, i, v) + bias;
+            double error = sigmoid(z) - y[i];
+
+            // w <- decay * w - lr * error * x, i.e. shrink s, then step v
+            s *= decay;
+            if (s == 0.0) {
+                std::fill(v.begin(), v.end(), 0.0);
+                s = 1.0;
+            }
+            double step = lr * error / s;
+            for (size_t p = X.rowPtr[i]; p < X.rowPtr[i + 1]; ++p)
+                v[X.colIdx[p]] -= step * X.values[p];
+            bias -= lr * error;
+
+            // Fold s back in before v grows out of range
+            if (std::abs(s) < 1e-100) {
+                for (double& vj : v) vj *= s;
+                s = 1.0;
+            }
+        }
+    }
+    PROFILE_COUNT("logistic.gradient_rows", uint64_t(epochs) * n_samples);
+
+    LogisticModel model;
+    model.weights.resize(X.cols);
+    for (size_t j = 0; j < X.cols; ++j) model.weights[j] = s * v[j];
+    model.bias = bias;
+    return model;
+}
+
+std::vector<int> predict_logistic(const LogisticModel& model, const CsrMatrix& X) {
+    PROFILE_SCOPE("score.logistic");
+    PROFILE_COUNT("score.rows", X.rows());
+    std::vector<double> z = csr_gemv(X, model.weights, model.bias);
+    std::vector<int> y_pred(z.size());
+    for (size_t i = 0; i < z.size(); ++i)
+        y_pred[i] = sigmoid(z[i]) >= 0.5 ? 1 : 0;
+    return y_pred;
+}
+
+template <typename T>
+double predict_proba(const LogisticModelT<T>& model, const std::vector<T>& x) {
+    return sigmoid(dot_n(model.weights.data(), x.data(), x.size()) + model.bias);
+}
+
+template <typename T>
+std::vector<int> predict_logistic(const LogisticModelT<T>& model, const Matrix<T>& X) {
+    PROFILE_SCOPE("score.logistic");
+    PROFILE_COUNT("score.rows", X.size());
     std::vector<int> y_pred;
     for (const auto& row : X)
         y_pred.push_back(predict_proba(model, row) >= 0.5 ? 1 : 0);
     return y_pred;
 }
 
+template <typename T>
+std::vector<int> predict_logistic(const LogisticModelT<T>& model, const Matrix<T>& X,
+                                  const std::vector<size_t>& rows) {
+    PROFILE_SCOPE("score.logistic");
+    PROFILE_COUNT("score.rows", rows.size());
+    std::vector<int> y_pred;
+    y_pred.reserve(rows.size());
+    for (size_t r : rows)
+        y_pred.push_back(predict_proba(model, X[r]) >= 0.5 ? 1 : 0);
+    return y_pred;
+}
+
+#define INSTANTIATE_LOGISTIC(T)                                                             \
+    template LogisticModelT<T> fit_logistic(const Matrix<T>&, const std::vector<int>&,      \
+                                            double, int, double, const Scaler*);            \
+    template LogisticModelT<T> fit_logistic(const Matrix<T>&, const std::vector<int>&,      \
+                                            const std::vector<double>&, double, int, double, \
+                                            const Scaler*);                                 \
+    template LogisticModelT<T> fit_logistic(const Matrix<T>&, const std::vector<int>&,      \
+                                            const std::vector<size_t>&, double, int, double, \
+                                            const Scaler*);                                 \
+    template LogisticModelT<T> fit_logistic(const Matrix<T>&, const std::vector<int>&,      \
+                                            const std::vector<size_t>&, double, int, double, \
+                                            const LogisticModelT<T>&, const Scaler*);       \
+    template double predict_proba(const LogisticModelT<T>&, const std::vector<T>&);         \
+    template std::vector<int> predict_logistic(const LogisticModelT<T>&, const Matrix<T>&); \
+    template std::vector<int> predict_logistic(const LogisticModelT<T>&, const Matrix<T>&,  \
+                                               const std::vector<size_t>&);
+
+INSTANTIATE_LOGISTIC(float)
+INSTANTIATE_LOGISTIC(double)
+
 double computeAccuracy(const std::vector<int>& y_true, const std::vector<int>& y_pred) {
-    size_t correct = 0;
-    for (size_t i = 0; i < y_true.size(); ++i)
-        if (y_true[i] == y_pred[i])
-            ++correct;
-    return double(correct) / y_true.size();
+    return confusion_matrix(y_true, y_pred).accuracy();
 }
 
 double macroF1(const std::vector<int>& y_true, const std::vector<int>& y_pred) {
-    int tp0 = 0, fp0 = 0, fn0 = 0;
-    int tp1 = 0, fp1 = 0, fn1 = 0;
-    
-    for (size_t i = 0; i < y_true.size(); ++i) {
-        if (y_true[i] == 0) {
-            if (y_pred[i] == 0) tp0++; 
-            else fn0++;
-        } else {
-            if (y_pred[i] == 1) tp1++; 
-            else fn1++;
-        }
-        
-        if (y_true[i] == 0 && y_pred[i] == 1) fp0++;
-        if (y_true[i] == 1 && y_pred[i] == 0) fp1++;
-    }
-    
-    double f1_0 = tp0 == 0 ? 0.0 : 2.0*tp0 / (2*tp0 + fp0 + fn0);
-    double f1_1 = tp1 == 0 ? 0.0 : 2.0*tp1 / (2*tp1 + fp1 + fn1);
-    
-    return (f1_0 + f1_1) / 2.0;
+    return confusion_matrix(y_true, y_pred).macroF1();
 }
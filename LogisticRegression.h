@@ -1,21 +1,71 @@
 #ifndef LOGISTICREGRESSION_H
 #define LOGISTICREGRESSION_H
 
+#include <cstddef>
 #include <vector>
 
-struct LogisticModel {
-    std::vector<double> weights;
-    double bias;
+#include "Scalar.h"
+#include "Scaler.h"
+#include "Sparse.h"
+
+template <typename T>
+struct LogisticModelT {
+    std::vector<T> weights;
+    T bias = 0;
 };
 
-LogisticModel fit_logistic(const std::vector<std::vector<double>>& X,
-                           const std::vector<int>& y,
+using LogisticModel = LogisticModelT<double>;
+
+// Dense fits and scoring are instantiated for float and double rows.
+// With a scaler, SGD runs on scaled rows (scaled on the fly) and the
+// weights are folded back, so the model always scores raw rows.
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               double lr, int epochs, double reg,
+                               const Scaler* scaler = nullptr);
+
+// Weighted SGD: row i's loss gradient is scaled by weights[i].
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<double>& weights,
+                               double lr, int epochs, double reg,
+                               const Scaler* scaler = nullptr);
+
+// Fits on the listed rows of X only, visiting them in the given order.
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<size_t>& rows,
+                               double lr, int epochs, double reg,
+                               const Scaler* scaler = nullptr);
+
+// Continues SGD from `init`. Training e1 epochs and then e2 more from the
+// result is identical to training e1 + e2 epochs in one call.
+template <typename T>
+LogisticModelT<T> fit_logistic(const Matrix<T>& X,
+                               const std::vector<int>& y,
+                               const std::vector<size_t>& rows,
+                               double lr, int epochs, double reg,
+                               const LogisticModelT<T>& init, const Scaler* scaler = nullptr);
+
+template <typename T>
+std::vector<int> predict_logistic(const LogisticModelT<T>& model, const Matrix<T>& X);
+
+template <typename T>
+std::vector<int> predict_logistic(const LogisticModelT<T>& model, const Matrix<T>& X,
+                                  const std::vector<size_t>& rows);
+
+// Sparse rows: each SGD step touches only the row's non-zeros. The L2
+// decay is kept lazy by storing the weights as s * v, so it costs O(1).
+LogisticModel fit_logistic(const CsrMatrix& X, const std::vector<int>& y,
                            double lr, int epochs, double reg);
 
-std::vector<int> predict_logistic(const LogisticModel& model,
-                                  const std::vector<std::vector<double>>& X);
+std::vector<int> predict_logistic(const LogisticModel& model, const CsrMatrix& X);
 
-double predict_proba(const LogisticModel& model, const std::vector<double>& x);
+template <typename T>
+double predict_proba(const LogisticModelT<T>& model, const std::vector<T>& x);
 
 double computeAccuracy(const std::vector<int>& y_true, const std::vector<int>& y_pred);
 
@@ -0,0 +1,247 @@
+#include "MemTrack.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sys/resource.h>
+
+namespace {
+
+std::atomic<uint64_t> g_allocs(0);
+std::atomic<uint64_t> g_frees(0);
+std::atomic<uint64_t> g_bytes(0);
+std::atomic<uint64_t> g_live(0);
+std::atomic<uint64_t> g_peak(0);
+
+// High-water marks of the running stages. Every allocation raises the
+// marks of the slots in use, so overlapping stages never reset each
+// other's peak the way a single shared mark would.
+const int kStageSlots = 64;
+std::atomic<bool> g_slotUsed[kStageSlots];
+std::atomic<uint64_t> g_slotPeak[kStageSlots];
+std::atomic<int> g_slotsHigh(0);   // slots at or past this index were never used
+
+void raise(std::atomic<uint64_t>& peak, uint64_t live) {
+    uint64_t seen = peak.load(std::memory_order_relaxed);
+    while (live > seen && !peak.compare_exchange_weak(seen, live, std::memory_order_relaxed)) {}
+}
+
+int acquire_slot(uint64_t live) {
+    for (int i = 0; i < kStageSlots; ++i) {
+        bool used = false;
+        if (g_slotUsed[i].load(std::memory_order_relaxed) ||
+            !g_slotUsed[i].compare_exchange_strong(used, true, std::memory_order_acq_rel))
+            continue;
+        g_slotPeak[i].store(live, std::memory_order_relaxed);
+        int high = g_slotsHigh.load(std::memory_order_relaxed);
+        while (high < i + 1 && !g_slotsHigh.compare_exchange_weak(high, i + 1)) {}
+        return i;
+    }
+    return -1;
+}
+
+std::mutex stages_lock;
+std::vector<MemStageStats>& stages() {
+    static std::vector<MemStageStats>* s = new std::vector<MemStageStats>();
+    return *s;
+}
+
+}  // namespace
+
+void memtrack_on_alloc(size_t bytes) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    uint64_t live = g_live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raise(g_peak, live);
+    int high = g_slotsHigh.load(std::memory_order_relaxed);
+    for (int i = 0; i < high; ++i)
+        if (g_slotUsed[i].load(std::memory_order_relaxed)) raise(g_slotPeak[i], live);
+}
+
+void memtrack_on_free(size_t bytes) {
+    g_frees.fetch_add(1, std::memory_order_relaxed);
+    g_live.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemCounters memtrack_snapshot() {
+    MemCounters c;
+    c.allocs = g_allocs.load(std::memory_order_relaxed);
+    c.frees = g_frees.load(std::memory_order_relaxed);
+    c.bytes = g_bytes.load(std::memory_order_relaxed);
+    c.live = g_live.load(std::memory_order_relaxed);
+    c.peak_live = g_peak.load(std::memory_order_relaxed);
+    return c;
+}
+
+long memtrack_peak_rss_kb() {
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+    return ru.ru_maxrss;   // kilobytes on Linux
+}
+
+// With more than kStageSlots stages running at once the extra ones only
+// see the live size at their start and end.
+MemStage::MemStage(const char* name)
+    : name_(name), start_(memtrack_snapshot()), slot_(acquire_slot(start_.live)) {}
+
+MemStage::~MemStage() {
+    MemCounters end = memtrack_snapshot();
+
+    MemStageStats s;
+    s.name = name_;
+    s.allocs = end.allocs - start_.allocs;
+    s.bytes = end.bytes - start_.bytes;
+    s.peak_live = std::max(start_.live, end.live);
+    if (slot_ >= 0) {
+        s.peak_live = std::max(s.peak_live, g_slotPeak[slot_].load(std::memory_order_relaxed));
+        g_slotUsed[slot_].store(false, std::memory_order_release);
+    }
+    s.live_delta = end.live > start_.live ? end.live - start_.live : 0;
+    s.peak_rss_kb = memtrack_peak_rss_kb();
+
+    std::lock_guard<std::mutex> g(stages_lock);
+    stages().push_back(s);
+}
+
+std::vector<MemStageStats> memtrack_stages() {
+    std::lock_guard<std::mutex> g(stages_lock);
+    return stages();
+}
+
+bool memtrack_write_report(const std::string& path) {
+    std::ofstream f(path);
+    if (!f.is_open()) return false;
+
+    std::vector<MemStageStats> all = memtrack_stages();
+    MemCounters total = memtrack_snapshot();
+    f << "{\n  \"total\": {\"allocs\": " << total.allocs << ", \"frees\": " << total.frees
+      << ", \"bytes\": " << total.bytes << ", \"peak_live\": " << total.peak_live
+      << ", \"peak_rss_kb\": " << memtrack_peak_rss_kb() << "},\n  \"stages\": [\n";
+    for (size_t i = 0; i < all.size(); ++i) {
+        const MemStageStats& s = all[i];
+        f << "    {\"name\": \"" << s.name << "\", \"allocs\": " << s.allocs
+          << ", \"bytes\": " << s.bytes << ", \"peak_live\": " << s.peak_live
+          << ", \"live_delta\": " << s.live_delta << ", \"peak_rss_kb\": " << s.peak_rss_kb << "}"
+          << (i + 1 < all.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+    return true;
+}
+
+void memtrack_print() {
+    std::vector<MemStageStats> all = memtrack_stages();
+    std::printf("%-20s %12s %14s %14s %14s %12s\n",
+                "stage", "allocs", "bytes", "peak live", "retained", "peak RSS KB");
+    for (const MemStageStats& s : all)
+        std::printf("%-20s %12llu %14llu %14llu %14llu %12ld\n", s.name.c_str(),
+                    (unsigned long long)s.allocs, (unsigned long long)s.bytes,
+                    (unsigned long long)s.peak_live, (unsigned long long)s.live_delta,
+                    s.peak_rss_kb);
+}
+
+void memtrack_dump() {
+#ifdef ML_MEMTRACK
+    memtrack_print();
+    const char* out = std::getenv("ML_MEMTRACK_OUT");
+    std::string path = out ? out : "memtrack_report.json";
+    if (memtrack_write_report(path))
+        std::cout << "Allocation report written to " << path << "\n";
+#endif
+}
+
+#ifdef ML_MEMTRACK
+
+// Global hook: every block carries a 16-byte header holding its size so
+// frees can be charged without relying on sized delete.
+namespace {
+
+const size_t kHeader = 16;
+
+void* tracked_alloc(size_t size) {
+    void* raw = std::malloc(size + kHeader);
+    if (!raw) return nullptr;
+    *static_cast<size_t*>(raw) = size;
+    memtrack_on_alloc(size);
+    return static_cast<char*>(raw) + kHeader;
+}
+
+void tracked_free(void* p) {
+    if (!p) return;
+    void* raw = static_cast<char*>(p) - kHeader;
+    memtrack_on_free(*static_cast<size_t*>(raw));
+    std::free(raw);
+}
+
+// Over-aligned blocks: the header sits just below the aligned pointer and
+// also holds the start of the underlying allocation.
+void* tracked_alloc_aligned(size_t size, std::align_val_t al) {
+    size_t align = std::max(size_t(al), kHeader);
+    void* raw = nullptr;
+    if (posix_memalign(&raw, align, size + align) != 0) return nullptr;
+    char* p = static_cast<char*>(raw) + align;
+    reinterpret_cast<size_t*>(p - kHeader)[0] = size;
+    reinterpret_cast<void**>(p - kHeader)[1] = raw;
+    memtrack_on_alloc(size);
+    return p;
+}
+
+void tracked_free_aligned(void* p) {
+    if (!p) return;
+    char* header = static_cast<char*>(p) - kHeader;
+    memtrack_on_free(reinterpret_cast<size_t*>(header)[0]);
+    std::free(reinterpret_cast<void**>(header)[1]);
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    void* p = tracked_alloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    void* p = tracked_alloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return tracked_alloc(size); }
+
+void operator delete(void* p) noexcept { tracked_free(p); }
+void operator delete[](void* p) noexcept { tracked_free(p); }
+void operator delete(void* p, size_t) noexcept { tracked_free(p); }
+void operator delete[](void* p, size_t) noexcept { tracked_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { tracked_free(p); }
+
+void* operator new(size_t size, std::align_val_t al) {
+    void* p = tracked_alloc_aligned(size, al);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t al) {
+    void* p = tracked_alloc_aligned(size, al);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return tracked_alloc_aligned(size, al);
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return tracked_alloc_aligned(size, al);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { tracked_free_aligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { tracked_free_aligned(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { tracked_free_aligned(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { tracked_free_aligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { tracked_free_aligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { tracked_free_aligned(p); }
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef MEMTRACK_H
+#define MEMTRACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Allocation accounting. Build with -DML_MEMTRACK (make MEMTRACK=1) to
+// replace the global operator new/delete with counting versions; the
+// MEM_STAGE macro then records allocation count, bytes, peak live heap
+// and peak RSS for each named pipeline stage. Without the flag the hook
+// is not installed and MEM_STAGE compiles to nothing.
+
+struct MemCounters {
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;        // total bytes requested
+    uint64_t live = 0;         // bytes currently allocated
+    uint64_t peak_live = 0;
+};
+
+struct MemStageStats {
+    std::string name;
+    uint64_t allocs = 0;
+    uint64_t bytes = 0;
+    uint64_t peak_live = 0;    // heap high-water mark while the stage ran
+    uint64_t live_delta = 0;   // bytes still held when the stage ended
+    long peak_rss_kb = 0;      // process high-water RSS at stage end
+};
+
+void memtrack_on_alloc(size_t bytes);
+void memtrack_on_free(size_t bytes);
+MemCounters memtrack_snapshot();
+long memtrack_peak_rss_kb();
+std::vector<MemStageStats> memtrack_stages();
+bool memtrack_write_report(const std::string& path);
+void memtrack_print();
+void memtrack_dump();
+
+// Records the allocation delta of a scope as one stage. Stages may nest
+// or overlap across threads; each keeps its own heap high-water mark.
+class MemStage {
+public:
+    explicit MemStage(const char* name);
+    ~MemStage();
+
+    MemStage(const MemStage&) = delete;
+    MemStage& operator=(const MemStage&) = delete;
+
+private:
+    const char* name_;
+    MemCounters start_;
+    int slot_;   // high-water slot, -1 when all are taken
+};
+
+// Allocator that charges its container to the tracker even when the
+// global hook is off; useful for sizing one structure in isolation.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        void* p = std::malloc(n * sizeof(T));
+        if (!p) throw std::bad_alloc();
+        memtrack_on_alloc(n * sizeof(T));
+        return static_cast<T*>(p);
+    }
+
+    void deallocate(T* p, size_t n) {
+        memtrack_on_free(n * sizeof(T));
+        std::free(p);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
+
+#ifdef ML_MEMTRACK
+#define MEM_STAGE_CONCAT_(a, b) a##b
+#define MEM_STAGE_CONCAT(a, b) MEM_STAGE_CONCAT_(a, b)
+#define MEM_STAGE(name) MemStage MEM_STAGE_CONCAT(mem_stage_, __LINE__)(name)
+#else
+#define MEM_STAGE(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,300 @@
+#include "Metrics.h"
+#include "Profiler.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+
+static const size_t kMetricsGrain = 65536;
+
+int ConfusionMatrix::index(int label) const {
+    auto it = std::lower_bound(classes.begin(), classes.end(), label);
+    return it != classes.end() && *it == label ? int(it - classes.begin()) : -1;
+}
+
+long long ConfusionMatrix::at(int true_label, int pred_label) const {
+    int t = index(true_label), p = index(pred_label);
+    if (t < 0 || p < 0) return 0;
+    return counts[size_t(t) * k + p];
+}
+
+long long ConfusionMatrix::support(int label) const {
+    int t = index(label);
+    if (t < 0) return 0;
+    long long s = 0;
+    for (size_t p = 0; p < k; ++p) s += counts[size_t(t) * k + p];
+    return s;
+}
+
+long long ConfusionMatrix::predicted(int label) const {
+    int p = index(label);
+    if (p < 0) return 0;
+    long long s = 0;
+    for (size_t t = 0; t < k; ++t) s += counts[t * k + p];
+    return s;
+}
+
+std::vector<int> ConfusionMatrix::labels() const {
+    std::vector<int> out;
+    for (int label : classes)
+        if (support(label) > 0) out.push_back(label);
+    return out;
+}
+
+double ConfusionMatrix::accuracy() const {
+    if (total == 0) return 0.0;
+    long long correct = 0;
+    for (size_t t = 0; t < k; ++t) correct += counts[t * k + t];
+    return double(correct) / total;
+}
+
+double ConfusionMatrix::precision(int label) const {
+    long long pred = predicted(label);
+    return pred == 0 ? 0.0 : double(at(label, label)) / pred;
+}
+
+double ConfusionMatrix::recall(int label) const {
+    long long sup = support(label);
+    return sup == 0 ? 0.0 : double(at(label, label)) / sup;
+}
+
+double ConfusionMatrix::f1(int label) const {
+    // 2tp / (2tp + fp + fn), which is 0 when tp is 0
+    long long tp = at(label, label);
+    long long denom = support(label) + predicted(label);
+    return tp == 0 ? 0.0 : 2.0 * tp / denom;
+}
+
+double ConfusionMatrix::macroF1() const {
+    std::vector<int> present = labels();
+    if (present.empty()) return 0.0;
+    double sum = 0.0;
+    for (int label : present) sum += f1(label);
+    return sum / present.size();
+}
+
+double ConfusionMatrix::microF1() const {
+    // Every row is exactly one prediction, so micro precision = recall = accuracy
+    return accuracy();
+}
+
+double ConfusionMatrix::weightedF1() const {
+    if (total == 0) return 0.0;
+    double sum = 0.0;
+    for (int label : labels()) sum += f1(label) * support(label);
+    return sum / total;
+}
+
+// Re-indexes a onto `classes`, a sorted superset of a.classes.
+static void widen(ConfusionMatrix& a, const std::vector<int>& classes) {
+    if (classes == a.classes) return;
+    size_t new_k = classes.size();
+    std::vector<size_t> to(a.k);
+    for (size_t i = 0; i < a.k; ++i)
+        to[i] = std::lower_bound(classes.begin(), classes.end(), a.classes[i]) - classes.begin();
+    std::vector<long long> counts(new_k * new_k, 0);
+    for (size_t t = 0; t < a.k; ++t)
+        for (size_t p = 0; p < a.k; ++p)
+            counts[to[t] * new_k + to[p]] = a.counts[t * a.k + p];
+    a.counts.swap(counts);
+    a.classes = classes;
+    a.k = new_k;
+}
+
+void merge(ConfusionMatrix& a, const ConfusionMatrix& b) {
+    if (b.k == 0) return;
+    if (a.k == 0) { a = b; return; }
+
+    std::vector<int> classes;
+    std::set_union(a.classes.begin(), a.classes.end(), b.classes.begin(), b.classes.end(),
+                   std::back_inserter(classes));
+    widen(a, classes);
+
+    std::vector<size_t> to(b.k);
+    for (size_t i = 0; i < b.k; ++i) to[i] = a.index(b.classes[i]);
+    for (size_t t = 0; t < b.k; ++t)
+        for (size_t p = 0; p < b.k; ++p)
+            a.counts[to[t] * a.k + to[p]] += b.counts[t * b.k + p];
+    a.total += b.total;
+}
+
+// Labels are usually a few small integers; a narrow range is indexed
+// through a direct table, anything else through the sorted distinct labels.
+static ConfusionMatrix count_chunk(const int* y_true, const int* y_pred, size_t n) {
+    ConfusionMatrix cm;
+    if (n == 0) return cm;
+
+    int lo = y_true[0], hi = y_true[0];
+    for (size_t i = 0; i < n; ++i) {
+        lo = std::min(lo, std::min(y_true[i], y_pred[i]));
+        hi = std::max(hi, std::max(y_true[i], y_pred[i]));
+    }
+
+    const long long kMaxTable = 4096;
+    long long range = (long long)hi - lo + 1;
+    std::vector<int> slot;
+    if (range <= kMaxTable) {
+        slot.assign(size_t(range), -1);
+        for (size_t i = 0; i < n; ++i) {
+            slot[size_t((long long)y_true[i] - lo)] = 0;
+            slot[size_t((long long)y_pred[i] - lo)] = 0;
+        }
+        for (long long v = 0; v < range; ++v)
+            if (slot[v] == 0) {
+                slot[v] = int(cm.classes.size());
+                cm.classes.push_back(int(lo + v));
+            }
+    } else {
+        cm.classes.assign(y_true, y_true + n);
+        cm.classes.insert(cm.classes.end(), y_pred, y_pred + n);
+        std::sort(cm.classes.begin(), cm.classes.end());
+        cm.classes.erase(std::unique(cm.classes.begin(), cm.classes.end()), cm.classes.end());
+    }
+    auto index = [&](int label) {
+        return slot.empty() ? size_t(cm.index(label)) : size_t(slot[size_t((long long)label - lo)]);
+    };
+
+    cm.k = cm.classes.size();
+    cm.counts.assign(cm.k * cm.k, 0);
+    long long* c = cm.counts.data();
+    const size_t k = cm.k;
+    for (size_t i = 0; i < n; ++i)
+        c[index(y_true[i]) * k + index(y_pred[i])]++;
+    cm.total = n;
+    return cm;
+}
+
+void accumulate(ConfusionMatrix& cm,
+                const std::vector<int>& y_true,
+                const std::vector<int>& y_pred) {
+    PROFILE_SCOPE("metrics.confusion");
+    size_t n = std::min(y_true.size(), y_pred.size());
+    ConfusionMatrix batch = parallel_reduce(size_t(0), n, kMetricsGrain, ConfusionMatrix(),
+        [&](size_t lo, size_t hi) { return count_chunk(&y_true[lo], &y_pred[lo], hi - lo); },
+        [](ConfusionMatrix& acc, const ConfusionMatrix& part) { merge(acc, part); });
+    merge(cm, batch);
+}
+
+ConfusionMatrix confusion_matrix(const std::vector<int>& y_true,
+                                 const std::vector<int>& y_pred) {
+    ConfusionMatrix cm;
+    accumulate(cm, y_true, y_pred);
+    return cm;
+}
+
+double RegressionStats::rmse() const {
+    return n == 0 ? 0.0 : std::sqrt(sum_sq / n);
+}
+
+double RegressionStats::mae() const {
+    return n == 0 ? 0.0 : sum_abs / n;
+}
+
+void accumulate(RegressionStats& stats,
+                const std::vector<double>& y_true,
+                const std::vector<double>& y_pred) {
+    size_t n = std::min(y_true.size(), y_pred.size());
+    RegressionStats batch = parallel_reduce(size_t(0), n, kMetricsGrain, RegressionStats(),
+        [&](size_t lo, size_t hi) {
+            RegressionStats part;
+            for (size_t i = lo; i < hi; ++i) {
+                double e = y_true[i] - y_pred[i];
+                part.sum_sq += e * e;
+                part.sum_abs += std::abs(e);
+            }
+            part.n = hi - lo;
+            return part;
+        },
+        [](RegressionStats& acc, const RegressionStats& part) {
+            acc.sum_sq += part.sum_sq;
+            acc.sum_abs += part.sum_abs;
+            acc.n += part.n;
+        });
+
+    stats.sum_sq += batch.sum_sq;
+    stats.sum_abs += batch.sum_abs;
+    stats.n += batch.n;
+}
+
+static double clamp_proba(double p) {
+    const double eps = 1e-15;
+    return std::min(std::max(p, eps), 1.0 - eps);
+}
+
+double ProbabilityStats::logLoss() const {
+    return n == 0 ? 0.0 : log_loss_sum / n;
+}
+
+double ProbabilityStats::auc() const {
+    // Walk bins from the lowest score up; ties inside a bin count half
+    long long pos = 0, neg = 0;
+    for (int b = 0; b < bins; ++b) {
+        pos += pos_hist[b];
+        neg += neg_hist[b];
+    }
+    if (pos == 0 || neg == 0) return 0.5;
+
+    double area = 0.0;
+    long long neg_below = 0;
+    for (int b = 0; b < bins; ++b) {
+        area += pos_hist[b] * (neg_below + 0.5 * neg_hist[b]);
+        neg_below += neg_hist[b];
+    }
+    return area / (double(pos) * neg);
+}
+
+static void reject_nan(const std::vector<double>& proba, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        if (std::isnan(proba[i])) throw std::runtime_error("NaN probability");
+}
+
+void accumulate(ProbabilityStats& stats,
+                const std::vector<int>& y_true,
+                const std::vector<double>& proba) {
+    size_t n = std::min(y_true.size(), proba.size());
+    reject_nan(proba, n);
+    for (size_t i = 0; i < n; ++i) {
+        double p = clamp_proba(proba[i]);
+        stats.log_loss_sum -= y_true[i] == 1 ? std::log(p) : std::log(1.0 - p);
+
+        // Clamped before the conversion, which is undefined out of int range.
+        double scaled = std::min(std::max(proba[i], 0.0), 1.0) * ProbabilityStats::bins;
+        int b = std::min(ProbabilityStats::bins - 1, int(scaled));
+        if (y_true[i] == 1) stats.pos_hist[b]++;
+        else stats.neg_hist[b]++;
+    }
+    stats.n += n;
+}
+
+double logLoss(const std::vector<int>& y_true, const std::vector<double>& proba) {
+    ProbabilityStats stats;
+    accumulate(stats, y_true, proba);
+    return stats.logLoss();
+}
+
+double rocAUC(const std::vector<int>& y_true, const std::vector<double>& proba) {
+    // Exact Mann-Whitney AUC with average ranks for tied scores
+    size_t n = std::min(y_true.size(), proba.size());
+    reject_nan(proba, n);   // NaN breaks the sort's ordering
+    std::vector<size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return proba[a] < proba[b]; });
+
+    double rank_sum = 0.0;
+    long long pos = 0;
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && proba[order[j]] == proba[order[i]]) ++j;
+        double avg_rank = (i + 1 + j) / 2.0;
+        for (size_t r = i; r < j; ++r)
+            if (y_true[order[r]] == 1) { rank_sum += avg_rank; ++pos; }
+        i = j;
+    }
+
+    long long neg = n - pos;
+    if (pos == 0 || neg == 0) return 0.5;
+    return (rank_sum - pos * (pos + 1) / 2.0) / (double(pos) * neg);
+}
@@ -0,0 +1,81 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstddef>
+#include <vector>
+
+// Dense confusion matrix over the distinct labels seen, true or predicted,
+// so sparse label values such as {0, 1000000} still give a 2 x 2 matrix.
+// counts[t * k + p] holds the rows with true label classes[t] predicted as
+// classes[p].
+struct ConfusionMatrix {
+    std::vector<int> classes;   // ascending
+    size_t k = 0;
+    std::vector<long long> counts;
+    long long total = 0;
+
+    int index(int label) const;             // position in classes, or -1
+    long long at(int true_label, int pred_label) const;
+    long long support(int label) const;     // rows whose true label is `label`
+    long long predicted(int label) const;   // rows predicted as `label`
+    std::vector<int> labels() const;        // labels present in y_true
+
+    double accuracy() const;
+    double precision(int label) const;
+    double recall(int label) const;
+    double f1(int label) const;
+    double macroF1() const;
+    double microF1() const;
+    double weightedF1() const;
+};
+
+// Builds the matrix in one pass, split into parallel chunks.
+ConfusionMatrix confusion_matrix(const std::vector<int>& y_true,
+                                 const std::vector<int>& y_pred);
+
+// Streaming form: folds another scored batch into cm.
+void accumulate(ConfusionMatrix& cm,
+                const std::vector<int>& y_true,
+                const std::vector<int>& y_pred);
+
+void merge(ConfusionMatrix& a, const ConfusionMatrix& b);
+
+// Squared-error accumulator for regression scores.
+struct RegressionStats {
+    double sum_sq = 0.0;
+    double sum_abs = 0.0;
+    long long n = 0;
+
+    double rmse() const;
+    double mae() const;
+};
+
+void accumulate(RegressionStats& stats,
+                const std::vector<double>& y_true,
+                const std::vector<double>& y_pred);
+
+// Binary probability scores: exact log-loss and a histogram-based AUC whose
+// resolution is 1 / bins. Histograms merge, so batches can be streamed.
+// Scores outside [0, 1] are clamped; NaN scores throw.
+struct ProbabilityStats {
+    static const int bins = 4096;
+    double log_loss_sum = 0.0;
+    long long n = 0;
+    std::vector<long long> pos_hist;
+    std::vector<long long> neg_hist;
+
+    ProbabilityStats() : pos_hist(bins, 0), neg_hist(bins, 0) {}
+
+    double logLoss() const;
+    double auc() const;
+};
+
+void accumulate(ProbabilityStats& stats,
+                const std::vector<int>& y_true,
+                const std::vector<double>& proba);
+
+double logLoss(const std::vector<int>& y_true, const std::vector<double>& proba);
+
+double rocAUC(const std::vector<int>& y_true, const std::vector<double>& proba);
+
+#endif
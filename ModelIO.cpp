@@ -0,0 +1,463 @@
+#include "ModelIO.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char kMagic[8] = {'M', 'L', 'M', 'O', 'D', 'E', 'L', '\0'};
+const uint32_t kVersion = 1;
+const uint64_t kAlign = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint32_t sections;
+    uint32_t reserved;
+    uint64_t fileSize;
+    unsigned char pad[32];
+};
+static_assert(sizeof(FileHeader) == 64, "header must stay 64 bytes");
+static_assert(sizeof(SectionEntry) == 24, "section entry layout changed");
+static_assert(sizeof(FlatTreeNode) == 24, "tree node layout changed");
+
+struct SectionData {
+    uint32_t id;
+    uint32_t elemSize;
+    const void* data;
+    uint64_t count;
+};
+
+bool hostLittleEndian() {
+    uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+uint64_t alignUp(uint64_t v) {
+    return (v + kAlign - 1) / kAlign * kAlign;
+}
+
+bool writeModel(const std::string& path, ModelKind kind, const std::vector<SectionData>& sections) {
+    if (!hostLittleEndian()) {
+        std::cerr << "Model files are little-endian; this host is not supported\n";
+        return false;
+    }
+
+    std::vector<SectionEntry> table(sections.size());
+    uint64_t offset = alignUp(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+    for (size_t i = 0; i < sections.size(); ++i) {
+        table[i].id = sections[i].id;
+        table[i].elemSize = sections[i].elemSize;
+        table[i].offset = offset;
+        table[i].count = sections[i].count;
+        offset = alignUp(offset + sections[i].count * sections[i].elemSize);
+    }
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.kind = kind;
+    header.sections = static_cast<uint32_t>(sections.size());
+    header.fileSize = offset;
+
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f.is_open()) {
+        std::cerr << "Failed to open file for writing: " << path << "\n";
+        return false;
+    }
+
+    static const char zeros[kAlign] = {};
+    uint64_t written = 0;
+    auto pad = [&](uint64_t to) {
+        f.write(zeros, to - written);
+        written = to;
+    };
+
+    f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionEntry));
+    written = sizeof(header) + table.size() * sizeof(SectionEntry);
+    for (size_t i = 0; i < sections.size(); ++i) {
+        pad(table[i].offset);
+        uint64_t bytes = sections[i].count * sections[i].elemSize;
+        f.write(static_cast<const char*>(sections[i].data), bytes);
+        written += bytes;
+    }
+    pad(header.fileSize);
+
+    if (!f) {
+        std::cerr << "Failed to write model: " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+SectionData sectionOf(uint32_t id, const std::vector<T>& v) {
+    return {id, sizeof(T), v.data(), v.size()};
+}
+
+int32_t flattenTree(const TreeNode* node, std::vector<FlatTreeNode>& out) {
+    int32_t idx = static_cast<int32_t>(out.size());
+    out.push_back({-1, node->label, -1, -1, node->threshold});
+    if (!node->isLeaf) {
+        out[idx].feature = node->featureIndex;
+        int32_t left = flattenTree(node->left, out);
+        int32_t right = flattenTree(node->right, out);
+        out[idx].left = left;
+        out[idx].right = right;
+    }
+    return idx;
+}
+
+// flattenTree writes preorder: a node's left child comes right after it,
+// its right child after the whole left subtree, and every node but the
+// root has exactly one parent. Holding a file to that layout rules out
+// cycles and shared subtrees, which would make a rebuild take time and
+// memory exponential in the depth.
+bool validTreeLinks(const FlatTreeNode* nodes, size_t count) {
+    std::vector<uint8_t> parents(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const FlatTreeNode& n = nodes[i];
+        if (n.feature < 0) continue;
+        if (n.left < 0 || n.right < 0 || size_t(n.left) != i + 1 ||
+            size_t(n.right) <= size_t(n.left) || size_t(n.right) >= count)
+            return false;
+        if (++parents[n.left] > 1 || ++parents[n.right] > 1) return false;
+    }
+    for (size_t i = 1; i < count; ++i)
+        if (parents[i] != 1) return false;
+    return true;
+}
+
+// Links must have passed validTreeLinks.
+TreeNode* rebuildTree(TreeArena& arena, const FlatTreeNode* nodes, int32_t idx) {
+    TreeNode* node = arena.make();
+    const FlatTreeNode& n = nodes[idx];
+    node->label = n.label;
+    node->threshold = n.threshold;
+    if (n.feature < 0) {
+        node->isLeaf = true;
+        return node;
+    }
+
+    node->featureIndex = n.feature;
+    node->isNumeric = true;
+    node->left = rebuildTree(arena, nodes, n.left);
+    node->right = rebuildTree(arena, nodes, n.right);
+    return node;
+}
+
+bool wrongKind(const ModelFile& file, ModelKind expected) {
+    if (file.kind() == expected) return false;
+    std::cerr << "Model file holds " << modelKindName(file.kind()) << ", expected "
+              << modelKindName(expected) << "\n";
+    return true;
+}
+
+bool corrupt(const char* what) {
+    std::cerr << "Corrupt model file: " << what << "\n";
+    return false;
+}
+
+}  // namespace
+
+const char* modelKindName(ModelKind kind) {
+    switch (kind) {
+        case MODEL_LINEAR: return "linear";
+        case MODEL_LOGISTIC: return "logistic";
+        case MODEL_KNN: return "knn";
+        case MODEL_TREE: return "tree";
+        case MODEL_GNB: return "gnb";
+        default: return "unknown";
+    }
+}
+
+bool save_model(const std::string& path, const LinearModel& model) {
+    std::vector<double> scalars = {model.bias};
+    return writeModel(path, MODEL_LINEAR,
+                      {sectionOf(SECTION_WEIGHTS, model.weights), sectionOf(SECTION_SCALARS, scalars)});
+}
+
+bool save_model(const std::string& path, const LogisticModel& model) {
+    std::vector<double> scalars = {model.bias};
+    return writeModel(path, MODEL_LOGISTIC,
+                      {sectionOf(SECTION_WEIGHTS, model.weights), sectionOf(SECTION_SCALARS, scalars)});
+}
+
+bool save_model(const std::string& path, const KNNModel& model) {
+    size_t n = model.X_train.size();
+    size_t d = n ? model.X_train[0].size() : 0;
+    std::vector<int64_t> shape = {model.k, int64_t(n), int64_t(d)};
+
+    std::vector<double> block(n * d);
+    for (size_t i = 0; i < n; ++i)
+        std::copy(model.X_train[i].begin(), model.X_train[i].end(), block.begin() + i * d);
+    std::vector<int32_t> labels(model.y_train.begin(), model.y_train.end());
+
+    std::vector<SectionData> sections = {sectionOf(SECTION_SHAPE, shape),
+                                         sectionOf(SECTION_TRAIN_X, block),
+                                         sectionOf(SECTION_TRAIN_Y, labels)};
+    std::vector<double> scaler;
+    if (model.scaler.active()) {
+        scaler.push_back(model.scaler.method);
+        scaler.insert(scaler.end(), model.scaler.shift.begin(), model.scaler.shift.end());
+        scaler.insert(scaler.end(), model.scaler.scale.begin(), model.scaler.scale.end());
+        sections.push_back(sectionOf(SECTION_SCALER, scaler));
+    }
+    return writeModel(path, MODEL_KNN, sections);
+}
+
+bool save_model(const std::string& path, const DecisionTreeModel& model) {
+    std::vector<FlatTreeNode> nodes;
+    if (model.root) flattenTree(model.root, nodes);
+    std::vector<int64_t> shape = {int64_t(model.features)};
+    return writeModel(path, MODEL_TREE, {sectionOf(SECTION_NODES, nodes), sectionOf(SECTION_SHAPE, shape)});
+}
+
+bool save_model(const std::string& path, const GaussianNBModel& model) {
+    size_t c = model.classes.size();
+    size_t d = c ? model.means[0].size() : 0;
+    std::vector<int64_t> shape = {int64_t(c), int64_t(d)};
+    std::vector<int32_t> classes(model.classes.begin(), model.classes.end());
+    std::vector<double> counts = model.counts;
+    counts.resize(c, 0.0);
+
+    std::vector<double> means, variances;
+    for (size_t i = 0; i < c; ++i) {
+        means.insert(means.end(), model.means[i].begin(), model.means[i].end());
+        variances.insert(variances.end(), model.variances[i].begin(), model.variances[i].end());
+    }
+
+    return writeModel(path, MODEL_GNB,
+                      {sectionOf(SECTION_SHAPE, shape), sectionOf(SECTION_CLASSES, classes),
+                       sectionOf(SECTION_PRIORS, model.priors), sectionOf(SECTION_COUNTS, counts),
+                       sectionOf(SECTION_MEANS, means), sectionOf(SECTION_VARIANCES, variances)});
+}
+
+ModelFile::~ModelFile() {
+    close();
+}
+
+void ModelFile::close() {
+    if (base_) munmap(const_cast<unsigned char*>(base_), size_);
+    base_ = nullptr;
+    size_ = 0;
+    kind_ = MODEL_NONE;
+    table_ = nullptr;
+    sections_ = 0;
+}
+
+bool ModelFile::open(const std::string& path) {
+    close();
+    if (!hostLittleEndian()) {
+        std::cerr << "Model files are little-endian; this host is not supported\n";
+        return false;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Failed to open file: " << path << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(FileHeader)) {
+        ::close(fd);
+        return corrupt("truncated header");
+    }
+
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "Failed to map file: " << path << "\n";
+        return false;
+    }
+    base_ = static_cast<const unsigned char*>(p);
+    size_ = st.st_size;
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(base_);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) {
+        close();
+        return corrupt("bad magic");
+    }
+    if (header->version != kVersion) {
+        close();
+        std::cerr << "Unsupported model version " << header->version << "\n";
+        return false;
+    }
+    if (header->fileSize > size_ ||
+        sizeof(FileHeader) + uint64_t(header->sections) * sizeof(SectionEntry) > size_) {
+        close();
+        return corrupt("truncated file");
+    }
+
+    table_ = reinterpret_cast<const SectionEntry*>(base_ + sizeof(FileHeader));
+    sections_ = header->sections;
+    for (uint32_t i = 0; i < sections_; ++i) {
+        const SectionEntry& e = table_[i];
+        if (e.elemSize == 0 || e.offset % 8 != 0 || e.offset > size_ ||
+            e.count > (size_ - e.offset) / e.elemSize) {
+            close();
+            return corrupt("section out of bounds");
+        }
+    }
+    kind_ = static_cast<ModelKind>(header->kind);
+    return true;
+}
+
+const SectionEntry* ModelFile::find(uint32_t id) const {
+    for (uint32_t i = 0; i < sections_; ++i)
+        if (table_[i].id == id) return &table_[i];
+    return nullptr;
+}
+
+bool load_model(const ModelFile& file, LinearModel& model) {
+    if (wrongKind(file, MODEL_LINEAR)) return false;
+    size_t nw = 0, ns = 0;
+    const double* w = file.section<double>(SECTION_WEIGHTS, &nw);
+    const double* s = file.section<double>(SECTION_SCALARS, &ns);
+    if (!w || !s || ns < 1) return corrupt("missing linear sections");
+    model.weights.assign(w, w + nw);
+    model.bias = s[0];
+    return true;
+}
+
+bool load_model(const ModelFile& file, LogisticModel& model) {
+    if (wrongKind(file, MODEL_LOGISTIC)) return false;
+    size_t nw = 0, ns = 0;
+    const double* w = file.section<double>(SECTION_WEIGHTS, &nw);
+    const double* s = file.section<double>(SECTION_SCALARS, &ns);
+    if (!w || !s || ns < 1) return corrupt("missing logistic sections");
+    model.weights.assign(w, w + nw);
+    model.bias = s[0];
+    return true;
+}
+
+bool load_model(const ModelFile& file, KNNModel& model) {
+    if (wrongKind(file, MODEL_KNN)) return false;
+    size_t nshape = 0, nx = 0, ny = 0;
+    const int64_t* shape = file.section<int64_t>(SECTION_SHAPE, &nshape);
+    const double* X = file.section<double>(SECTION_TRAIN_X, &nx);
+    const int32_t* y = file.section<int32_t>(SECTION_TRAIN_Y, &ny);
+    if (!shape || nshape < 3 || !X || !y) return corrupt("missing knn sections");
+
+    size_t n = shape[1], d = shape[2];
+    if (nx != n * d || ny != n) return corrupt("knn shape mismatch");
+
+    model.k = static_cast<int>(shape[0]);
+    model.X_train.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        model.X_train[i].assign(X + i * d, X + (i + 1) * d);
+    model.y_train.assign(y, y + n);
+
+    size_t ns = 0;
+    const double* s = file.section<double>(SECTION_SCALER, &ns);
+    model.scaler = Scaler();
+    if (s) {
+        if (ns != 1 + 2 * d) return corrupt("knn scaler size");
+        model.scaler.method = static_cast<ScaleMethod>(int(s[0]));
+        model.scaler.shift.assign(s + 1, s + 1 + d);
+        model.scaler.scale.assign(s + 1 + d, s + 1 + 2 * d);
+    }
+    return true;
+}
+
+bool load_model(const ModelFile& file, DecisionTreeModel& model) {
+    if (wrongKind(file, MODEL_TREE)) return false;
+    size_t count = 0;
+    const FlatTreeNode* nodes = file.section<FlatTreeNode>(SECTION_NODES, &count);
+    if (!nodes) return corrupt("missing tree nodes");
+
+    if (!validTreeLinks(nodes, count)) return corrupt("bad tree links");
+
+    model.nodes = std::make_shared<TreeArena>(count ? count : 1);
+    model.root = count ? rebuildTree(*model.nodes, nodes, 0) : nullptr;
+    size_t nshape = 0;
+    const int64_t* shape = file.section<int64_t>(SECTION_SHAPE, &nshape);
+    model.features = shape && nshape >= 1 ? size_t(shape[0]) : 0;
+    return true;
+}
+
+bool load_model(const ModelFile& file, GaussianNBModel& model) {
+    if (wrongKind(file, MODEL_GNB)) return false;
+    size_t nshape = 0, nc = 0, np = 0, ncount = 0, nm = 0, nv = 0;
+    const int64_t* shape = file.section<int64_t>(SECTION_SHAPE, &nshape);
+    const int32_t* classes = file.section<int32_t>(SECTION_CLASSES, &nc);
+    const double* priors = file.section<double>(SECTION_PRIORS, &np);
+    const double* counts = file.section<double>(SECTION_COUNTS, &ncount);
+    const double* means = file.section<double>(SECTION_MEANS, &nm);
+    const double* vars = file.section<double>(SECTION_VARIANCES, &nv);
+    if (!shape || nshape < 2 || !classes || !priors || !counts || !means || !vars)
+        return corrupt("missing gnb sections");
+
+    size_t c = shape[0], d = shape[1];
+    if (nc != c || np != c || ncount != c || nm != c * d || nv != c * d)
+        return corrupt("gnb shape mismatch");
+
+    model.classes.assign(classes, classes + c);
+    model.priors.assign(priors, priors + c);
+    model.counts.assign(counts, counts + c);
+    model.means.resize(c);
+    model.variances.resize(c);
+    for (size_t i = 0; i < c; ++i) {
+        model.means[i].assign(means + i * d, means + (i + 1) * d);
+        model.variances[i].assign(vars + i * d, vars + (i + 1) * d);
+    }
+    return true;
+}
+
+bool open_flat_tree(const ModelFile& file, FlatTreeView& tree) {
+    if (wrongKind(file, MODEL_TREE)) return false;
+    size_t count = 0;
+    const FlatTreeNode* nodes = file.section<FlatTreeNode>(SECTION_NODES, &count);
+    if (!nodes || count == 0) return corrupt("missing tree nodes");
+
+    if (!validTreeLinks(nodes, count)) return corrupt("bad tree links");
+
+    size_t features = 0;
+    for (size_t i = 0; i < count; ++i)
+        if (nodes[i].feature >= 0) features = std::max(features, size_t(nodes[i].feature) + 1);
+    // Files written before the width was stored only bound it from below.
+    size_t nshape = 0;
+    const int64_t* shape = file.section<int64_t>(SECTION_SHAPE, &nshape);
+    tree.exactWidth = shape && nshape >= 1;
+    if (tree.exactWidth) {
+        if (shape[0] < int64_t(features)) return corrupt("tree feature count");
+        features = size_t(shape[0]);
+    }
+    tree.nodes = nodes;
+    tree.count = count;
+    tree.features = features;
+    return true;
+}
+
+std::vector<int> predict_flat_tree(const FlatTreeView& tree,
+                                   const std::vector<std::vector<double>>& X) {
+    PROFILE_SCOPE("score.tree");
+    PROFILE_COUNT("score.rows", X.size());
+    for (const auto& row : X)
+        if (row.size() < tree.features)
+            throw std::runtime_error("Expected " + std::to_string(tree.features) + " features per row");
+
+    std::vector<int> y_pred;
+    y_pred.reserve(X.size());
+    for (const auto& row : X) {
+        const FlatTreeNode* n = tree.nodes;
+        while (n->feature >= 0)
+            n = tree.nodes + (row[n->feature] <= n->threshold ? n->left : n->right);
+        y_pred.push_back(n->label);
+    }
+    return y_pred;
+}
@@ -0,0 +1,138 @@
+#ifndef MODELIO_H
+#define MODELIO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LinearRegression.h"
+#include "LogisticRegression.h"
+#include "KNN.h"
+#include "DecisionTree.h"
+#include "GaussianNB.h"
+
+// Binary model files (little-endian, version 1):
+//
+//   header   64 bytes: magic "MLMODEL\0", version, kind, section count, file size
+//   table    one SectionEntry per section
+//   sections each starts on a 64-byte boundary and holds a flat array
+//
+// Every section is a plain array of fixed-width values, so a mapped file
+// can be used in place: ModelFile exposes typed pointers straight into the
+// mapping. The server scores trees from the mapped nodes (FlatTreeView);
+// the other models are small, except k-NN, whose rows the server copies
+// into an index it can update (KNNIndex).
+
+enum ModelKind : uint32_t {
+    MODEL_NONE = 0,
+    MODEL_LINEAR = 1,
+    MODEL_LOGISTIC = 2,
+    MODEL_KNN = 3,
+    MODEL_TREE = 4,
+    MODEL_GNB = 5,
+};
+
+enum SectionId : uint32_t {
+    SECTION_WEIGHTS = 1,   // f64[d]
+    SECTION_SCALARS = 2,   // f64[]: bias, ...
+    SECTION_SHAPE = 3,     // i64[]: model dimensions (tree: feature count)
+    SECTION_TRAIN_X = 4,   // f64[n * d], row-major
+    SECTION_TRAIN_Y = 5,   // i32[n]
+    SECTION_NODES = 6,     // FlatTreeNode[]
+    SECTION_CLASSES = 7,   // i32[c]
+    SECTION_PRIORS = 8,    // f64[c]
+    SECTION_COUNTS = 9,    // f64[c]
+    SECTION_MEANS = 10,    // f64[c * d]
+    SECTION_VARIANCES = 11,// f64[c * d]
+    SECTION_SCALER = 12    // f64[1 + 2d]: method, shift[d], scale[d] (k-NN, optional)
+};
+
+struct SectionEntry {
+    uint32_t id;
+    uint32_t elemSize;
+    uint64_t offset;
+    uint64_t count;
+};
+
+// Tree nodes in preorder; node 0 is the root, leaves have feature -1.
+struct FlatTreeNode {
+    int32_t feature;
+    int32_t label;
+    int32_t left;
+    int32_t right;
+    double threshold;
+};
+
+const char* modelKindName(ModelKind kind);
+
+bool save_model(const std::string& path, const LinearModel& model);
+bool save_model(const std::string& path, const LogisticModel& model);
+bool save_model(const std::string& path, const KNNModel& model);
+bool save_model(const std::string& path, const DecisionTreeModel& model);
+bool save_model(const std::string& path, const GaussianNBModel& model);
+
+// Read-only mapping of a model file. Section pointers stay valid for the
+// lifetime of the ModelFile.
+class ModelFile {
+public:
+    ModelFile() = default;
+    ~ModelFile();
+    ModelFile(const ModelFile&) = delete;
+    ModelFile& operator=(const ModelFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    ModelKind kind() const { return kind_; }
+
+    template <typename T>
+    const T* section(uint32_t id, size_t* count) const {
+        const SectionEntry* e = find(id);
+        if (!e || e->elemSize != sizeof(T)) {
+            if (count) *count = 0;
+            return nullptr;
+        }
+        if (count) *count = e->count;
+        return reinterpret_cast<const T*>(base_ + e->offset);
+    }
+
+private:
+    const SectionEntry* find(uint32_t id) const;
+
+    const unsigned char* base_ = nullptr;
+    size_t size_ = 0;
+    ModelKind kind_ = MODEL_NONE;
+    const SectionEntry* table_ = nullptr;
+    uint32_t sections_ = 0;
+};
+
+// Builds an owning model from an open file; false if the kind does not match.
+bool load_model(const ModelFile& file, LinearModel& model);
+bool load_model(const ModelFile& file, LogisticModel& model);
+bool load_model(const ModelFile& file, KNNModel& model);
+bool load_model(const ModelFile& file, DecisionTreeModel& model);
+bool load_model(const ModelFile& file, GaussianNBModel& model);
+
+template <typename Model>
+bool load_model(const std::string& path, Model& model) {
+    ModelFile file;
+    return file.open(path) && load_model(file, model);
+}
+
+// A tree scored straight from the mapped node array. open_flat_tree checks
+// every link once (children after their parent and in range), so scoring
+// can neither leave the array nor loop; rows need `features` columns.
+struct FlatTreeView {
+    const FlatTreeNode* nodes = nullptr;
+    size_t count = 0;
+    size_t features = 0;       // training width, or highest split feature + 1
+    bool exactWidth = false;   // features is the training width
+};
+
+bool open_flat_tree(const ModelFile& file, FlatTreeView& tree);
+
+std::vector<int> predict_flat_tree(const FlatTreeView& tree,
+                                   const std::vector<std::vector<double>>& X);
+
+#endif
@@ -0,0 +1,130 @@
+#include "Parallel.h"
+
+namespace {
+
+// Read on every parallel_for, so both are atomics; writers still take
+// g_runtimeLock to keep them in step with g_pool.
+std::mutex g_runtimeLock;
+std::atomic<size_t> g_threads{0};      // 0 = hardware threads
+std::unique_ptr<ThreadPool> g_pool;
+std::atomic<ThreadPool*> g_poolPtr{nullptr};
+
+// Pool and deque index of the worker running on this thread, if any.
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_worker = 0;
+
+size_t hardware_threads() {
+    static const size_t threads = [] {
+        unsigned hw = std::thread::hardware_concurrency();
+        return hw == 0 ? size_t(1) : size_t(hw);
+    }();
+    return threads;
+}
+
+} // namespace
+
+size_t num_threads() {
+    size_t threads = g_threads.load();
+    return threads ? threads : hardware_threads();
+}
+
+void set_num_threads(size_t threads) {
+    std::unique_ptr<ThreadPool> old;
+    {
+        std::lock_guard<std::mutex> g(g_runtimeLock);
+        if (threads == g_threads.load()) return;
+        g_threads = threads;
+        g_poolPtr = nullptr;
+        old = std::move(g_pool);
+    }
+}
+
+ThreadPool& shared_pool() {
+    if (ThreadPool* pool = g_poolPtr.load()) return *pool;
+    size_t threads = num_threads();
+    std::lock_guard<std::mutex> g(g_runtimeLock);
+    if (!g_pool) {
+        g_pool.reset(new ThreadPool(threads));
+        g_poolPtr = g_pool.get();
+    }
+    return *g_pool;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = num_threads();
+    for (size_t t = 0; t < threads; ++t)
+        queues_.emplace_back(new Queue);
+    for (size_t t = 0; t < threads; ++t)
+        workers_.emplace_back([this, t]() { work(t); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> g(sleepLock_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void ThreadPool::push(std::function<void()> task, const void* owner) {
+    // Count the task before it becomes visible, so a worker that takes it
+    // never sees pending_ drop below zero.
+    {
+        std::lock_guard<std::mutex> g(sleepLock_);
+        ++pending_;
+    }
+    size_t q = t_pool == this ? t_worker : nextQueue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> g(queues_[q]->lock);
+        queues_[q]->tasks.push_back({std::move(task), owner});
+    }
+    ready_.notify_one();
+}
+
+size_t ThreadPool::cancel(const void* owner) {
+    size_t dropped = 0;
+    for (auto& q : queues_) {
+        std::lock_guard<std::mutex> g(q->lock);
+        auto keep = std::remove_if(q->tasks.begin(), q->tasks.end(),
+                                   [owner](const Task& t) { return t.owner == owner; });
+        dropped += q->tasks.end() - keep;
+        q->tasks.erase(keep, q->tasks.end());
+    }
+    pending_ -= dropped;
+    return dropped;
+}
+
+bool ThreadPool::pop(size_t self, std::function<void()>& task) {
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        Queue& q = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> g(q.lock);
+        if (q.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(q.tasks.back().fn);
+            q.tasks.pop_back();
+        } else {
+            task = std::move(q.tasks.front().fn);
+            q.tasks.pop_front();
+        }
+        --pending_;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t self) {
+    t_pool = this;
+    t_worker = self;
+    while (true) {
+        std::function<void()> task;
+        if (pop(self, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> g(sleepLock_);
+        if (pending_ == 0 && stopping_) return;
+        ready_.wait(g, [this]() { return stopping_ || pending_ > 0; });
+        if (pending_ == 0 && stopping_) return;
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker count of the shared runtime; defaults to the hardware threads.
+// set_num_threads(0) restores the default. Call it while no parallel work
+// is running: it replaces the shared pool.
+size_t num_threads();
+void set_num_threads(size_t threads);
+
+// Work-stealing pool. Each worker owns a deque: it runs its own tasks
+// newest first and, when empty, steals the oldest task of another worker.
+// Tasks submitted from inside a worker go to that worker's deque.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0);   // 0 = num_threads()
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    template <typename F>
+    auto submit(F fn) -> std::future<decltype(fn())> {
+        using R = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<R()>>(std::move(fn));
+        std::future<R> result = task->get_future();
+        push([task]() { (*task)(); });
+        return result;
+    }
+
+    // owner tags the task for cancel(); it is never dereferenced.
+    void push(std::function<void()> task, const void* owner = nullptr);
+
+    // Drops the tasks pushed with this owner that no worker has started
+    // yet and returns how many there were.
+    size_t cancel(const void* owner);
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        const void* owner;
+    };
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(size_t self, std::function<void()>& task);
+    void work(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex sleepLock_;
+    std::condition_variable ready_;
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> nextQueue_{0};
+    bool stopping_ = false;
+};
+
+// The pool every module shares, sized by num_threads().
+ThreadPool& shared_pool();
+
+// Runs fn(lo, hi) over [begin, end) split into chunks of `grain` rows.
+// Chunk boundaries depend only on the range and grain, never on the
+// thread count, so per-chunk results can be merged deterministically.
+// The caller works through chunks too, so nesting inside a pool task
+// cannot deadlock: idle workers help, busy ones are not waited for.
+template <typename F>
+void parallel_for(size_t begin, size_t end, size_t grain, F fn) {
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+    size_t helpers = std::min(num_threads(), chunks) - 1;
+
+    auto chunk = [&](size_t c) {
+        fn(begin + c * grain, std::min(end, begin + (c + 1) * grain));
+    };
+    if (helpers == 0) {
+        for (size_t c = 0; c < chunks; ++c) chunk(c);
+        return;
+    }
+
+    // Helpers touch `chunk` only through a claimed chunk, and the caller
+    // waits for all of those; `state` they co-own.
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex lock;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    auto run = [state, chunks, &chunk]() {
+        for (size_t c = state->next++; c < chunks; c = state->next++) {
+            chunk(c);
+            if (++state->done == chunks) {
+                std::lock_guard<std::mutex> g(state->lock);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    ThreadPool& pool = shared_pool();
+    for (size_t h = 0; h < helpers; ++h)
+        pool.push(run, state.get());
+    run();
+
+    // Every chunk is claimed: helpers that have not started would find
+    // nothing to do, so take them off the queues, then sleep until the
+    // chunks other threads claimed are done.
+    pool.cancel(state.get());
+    std::unique_lock<std::mutex> g(state->lock);
+    state->finished.wait(g, [&]() { return state->done.load() == chunks; });
+}
+
+// Maps every chunk to a partial result with map(lo, hi) and folds the
+// partials left to right with merge(acc, part).
+template <typename T, typename Map, typename Merge>
+T parallel_reduce(size_t begin, size_t end, size_t grain, T init, Map map, Merge merge) {
+    if (end <= begin) return init;
+    if (grain == 0) grain = 1;
+    size_t chunks = (end - begin + grain - 1) / grain;
+
+    std::vector<T> partials(chunks);
+    parallel_for(0, chunks, 1, [&](size_t lo, size_t hi) {
+        for (size_t c = lo; c < hi; ++c)
+            partials[c] = map(begin + c * grain, std::min(end, begin + (c + 1) * grain));
+    });
+
+    for (auto& part : partials)
+        merge(init, part);
+    return init;
+}
+
+// Counter-based random stream: the i-th draw of stream s under a seed is a
+// pure function of (seed, s, i), so a task that takes stream s sees the
+// same numbers no matter which thread runs it or in what order.
+class RngStream {
+public:
+    using result_type = uint64_t;
+
+    RngStream(uint64_t seed, uint64_t stream = 0)
+        : key_(mix(seed ^ mix(stream + 0x632be59bd9b4e019ULL))) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~result_type(0); }
+
+    result_type operator()() { return mix(key_ + ++counter_ * 0x9e3779b97f4a7c15ULL); }
+
+    // Uniform in [0, n), n > 0.
+    uint64_t below(uint64_t n) {
+        return uint64_t((unsigned __int128)(*this)() * n >> 64);
+    }
+
+    // Uniform in [0, 1).
+    double uniform() { return ((*this)() >> 11) * 0x1.0p-53; }
+
+private:
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t key_;
+    uint64_t counter_ = 0;
+};
+
+// Fisher-Yates with RngStream draws. Unlike std::shuffle the result does
+// not depend on the standard library, only on the stream.
+template <typename T>
+void deterministic_shuffle(std::vector<T>& v, RngStream& rng) {
+    for (size_t i = v.size(); i > 1; --i)
+        std::swap(v[i - 1], v[rng.below(i)]);
+}
+
+#endif
@@ -0,0 +1,444 @@
+#include "Pipeline.h"
+#include "loadData.h"
+#include "LinearRegression.h"
+#include "LogisticRegression.h"
+#include "KNN.h"
+#include "DecisionTree.h"
+#include "GaussianNB.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include "ModelIO.h"
+#include <algorithm>
+#include <numeric>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <sstream>
+
+static const char* kAlgorithms[] = {"linear", "logistic", "knn", "tree", "gnb"};
+
+static bool knownAlgorithm(const std::string& name) {
+    for (const char* a : kAlgorithms)
+        if (name == a) return true;
+    return false;
+}
+
+static void scoreClassifier(PipelineResult& r, const std::vector<int>& y_true,
+                            const std::vector<int>& y_pred) {
+    ConfusionMatrix cm = confusion_matrix(y_true, y_pred);
+    r.accuracy = cm.accuracy();
+    r.macroF1 = cm.macroF1();
+}
+
+template <typename Model>
+static void saveIfRequested(const std::string& saveDir, const std::string& algo,
+                            const Model& model, PipelineResult& r) {
+    if (saveDir.empty()) return;
+    if (!save_model(saveDir + "/" + algo + ".model", model))
+        r.error = "could not save model";
+}
+
+// Trains and scores one algorithm on the shared split. Only reads `data`.
+// With `distinct` (the deduplicated training rows), every model but k-NN,
+// whose votes count copies, fits on those with their counts as weights.
+static PipelineResult trainAndEvaluate(const std::string& algo, const Dataset& data,
+                                       const WeightedSet* distinct, const Scaler& scaler,
+                                       const Hyperparams& p, const std::string& saveDir) {
+    PipelineResult r;
+    r.algorithm = algo;
+    // Trees split on order and Gaussian NB is per-feature affine invariant,
+    // so only the other three models take the scaler.
+    const Scaler* sp = scaler.active() ? &scaler : nullptr;
+
+    try {
+        if (algo == "linear") {
+            r.regression = true;
+            std::vector<double> y_test_d(data.y_test.begin(), data.y_test.end());
+            LinearModel model;
+            std::vector<double> y_pred;
+            {
+                ScopedTimer timer("train.linear", &r.trainTime);
+                if (distinct) {
+                    std::vector<double> y_d(distinct->y.begin(), distinct->y.end());
+                    model = fit_linear(distinct->X, y_d, distinct->weights, p.lambda, sp);
+                } else {
+                    std::vector<double> y_train_d(data.y_train.begin(), data.y_train.end());
+                    model = fit_linear(data.X_train, y_train_d, p.lambda, sp);
+                }
+            }
+            saveIfRequested(saveDir, algo, model, r);
+            {
+                ScopedTimer timer("predict.linear", &r.predictTime);
+                y_pred = predict_linear(model, data.X_test);
+            }
+            r.rmse = computeRMSE(y_test_d, y_pred);
+        }
+        else if (algo == "logistic") {
+            LogisticModel model;
+            std::vector<int> y_pred;
+            {
+                ScopedTimer timer("train.logistic", &r.trainTime);
+                if (distinct)
+                    model = fit_logistic(distinct->X, distinct->y, distinct->weights,
+                                         p.lr, p.epochs, p.reg, sp);
+                else
+                    model = fit_logistic(data.X_train, data.y_train, p.lr, p.epochs, p.reg, sp);
+            }
+            saveIfRequested(saveDir, algo, model, r);
+            {
+                ScopedTimer timer("predict.logistic", &r.predictTime);
+                y_pred = predict_logistic(model, data.X_test);
+            }
+            scoreClassifier(r, data.y_test, y_pred);
+        }
+        else if (algo == "knn") {
+            KNNModel model;
+            std::vector<int> y_pred;
+            {
+                ScopedTimer timer("train.knn", &r.trainTime);
+                model = fit_knn(data.X_train, data.y_train, p.k, sp);
+            }
+            saveIfRequested(saveDir, algo, model, r);
+            {
+                ScopedTimer timer("predict.knn", &r.predictTime);
+                y_pred = predict_knn(model, data.X_test);
+            }
+            scoreClassifier(r, data.y_test, y_pred);
+        }
+        else if (algo == "tree") {
+            DecisionTreeModel model;
+            std::vector<int> y_pred;
+            {
+                ScopedTimer timer("train.tree", &r.trainTime);
+                if (distinct)
+                    model = fit_tree(distinct->X, distinct->y, distinct->weights, p.maxDepth);
+                else
+                    model = fit_tree(data.X_train, data.y_train, p.maxDepth);
+            }
+            saveIfRequested(saveDir, algo, model, r);
+            {
+                ScopedTimer timer("predict.tree", &r.predictTime);
+                y_pred = predict_tree(model, data.X_test);
+            }
+            scoreClassifier(r, data.y_test, y_pred);
+        }
+        else if (algo == "gnb") {
+            GaussianNBModel model;
+            std::vector<int> y_pred;
+            {
+                ScopedTimer timer("train.gnb", &r.trainTime);
+                if (distinct)
+                    model = fit_gnb(distinct->X, distinct->y, distinct->weights);
+                else
+                    model = fit_gnb(data.X_train, data.y_train);
+            }
+            saveIfRequested(saveDir, algo, model, r);
+            {
+                ScopedTimer timer("predict.gnb", &r.predictTime);
+                y_pred = predict_gnb(model, data.X_test);
+            }
+            scoreClassifier(r, data.y_test, y_pred);
+        }
+    }
+    catch (const std::exception& e) {
+        r.error = e.what();
+    }
+    return r;
+}
+
+struct SparseSplit {
+    CsrMatrix X_train, X_test;
+    std::vector<int> y_train, y_test;
+};
+
+// Same shuffle as splitDataset, applied to a one-hot CSR dataset.
+static SparseSplit splitSparse(const SparseDataset& data, double trainFraction, uint64_t seed) {
+    size_t n = data.X.rows();
+    std::vector<size_t> indices(n);
+    std::iota(indices.begin(), indices.end(), 0);
+    RngStream rng(seed);
+    deterministic_shuffle(indices, rng);
+
+    size_t trainSize = static_cast<size_t>(n * trainFraction);
+    std::vector<size_t> train(indices.begin(), indices.begin() + trainSize);
+    std::vector<size_t> test(indices.begin() + trainSize, indices.end());
+
+    SparseSplit split;
+    split.X_train = csr_select_rows(data.X, train);
+    split.X_test = csr_select_rows(data.X, test);
+    for (size_t i : train) split.y_train.push_back(data.y[i]);
+    for (size_t i : test) split.y_test.push_back(data.y[i]);
+    return split;
+}
+
+static PipelineResult trainAndEvaluateSparse(const std::string& algo, const SparseSplit& data,
+                                             const Hyperparams& p) {
+    PipelineResult r;
+    r.algorithm = algo;
+
+    try {
+        if (algo == "linear") {
+            r.regression = true;
+            std::vector<double> y_train_d(data.y_train.begin(), data.y_train.end());
+            std::vector<double> y_test_d(data.y_test.begin(), data.y_test.end());
+            LinearModel model;
+            std::vector<double> y_pred;
+            {
+                ScopedTimer timer("train.linear", &r.trainTime);
+                model = fit_linear(data.X_train, y_train_d, p.lambda);
+            }
+            {
+                ScopedTimer timer("predict.linear", &r.predictTime);
+                y_pred = predict_linear(model, data.X_test);
+            }
+            r.rmse = computeRMSE(y_test_d, y_pred);
+        }
+        else if (algo == "logistic") {
+            LogisticModel model;
+            std::vector<int> y_pred;
+            {
+                ScopedTimer timer("train.logistic", &r.trainTime);
+                model = fit_logistic(data.X_train, data.y_train, p.lr, p.epochs, p.reg);
+            }
+            {
+                ScopedTimer timer("predict.logistic", &r.predictTime);
+                y_pred = predict_logistic(model, data.X_test);
+            }
+            scoreClassifier(r, data.y_test, y_pred);
+        }
+        else {
+            r.error = "not available for --sparse input";
+        }
+    }
+    catch (const std::exception& e) {
+        r.error = e.what();
+    }
+    return r;
+}
+
+static std::vector<std::string> splitList(const std::string& s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string tok;
+    while (std::getline(ss, tok, ','))
+        if (!tok.empty()) out.push_back(tok);
+    return out;
+}
+
+void printPipelineUsage(const char* prog) {
+    std::cout << "Usage: " << prog << " --data FILE --target COL [options]\n"
+              << "  --algos LIST       comma-separated: linear,logistic,knn,tree,gnb (default all)\n"
+              << "  --seed N           train/test split seed (default 42)\n"
+              << "  --threads N        worker threads shared by all stages (default: hardware)\n"
+              << "  --train-fraction F (default 0.8)\n"
+              << "  --save-dir DIR     write each trained model to DIR/<algo>.model\n"
+              << "  --cv K             K-fold cross-validation instead of one split\n"
+              << "  --stratified       keep class proportions in every fold (with --cv)\n"
+              << "  --lambda L --lr R --epochs N --reg G --k K --max-depth D\n"
+              << "                     model settings (defaults 0.1, 0.01, 100, 0, 5, 10)\n"
+              << "  --scale METHOD     none|standard|minmax|robust feature scaling (default none)\n"
+              << "  --sample N         load a seeded reservoir sample of N rows (reads the file once)\n"
+              << "  --sample-stratified with --sample, keep each class's share of the file\n"
+              << "  --dedup            fit on distinct training rows weighted by their counts\n"
+              << "                     (k-NN still sees every copy)\n"
+              << "  --sparse           one-hot encode text columns into a sparse matrix\n"
+              << "                     (linear and logistic only, no --scale/--save-dir)\n"
+              << "  --tune grid|random search model settings by cross-validation\n"
+              << "  --trials N         random search: candidates per algorithm (default 20)\n"
+              << "Run without arguments for the interactive menu, or with --selftest to\n"
+              << "check every compiled kernel variant against the scalar reference.\n";
+}
+
+bool parsePipelineArgs(int argc, char** argv, PipelineConfig& config) {
+    bool algosGiven = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--data" && hasValue) config.dataPath = argv[++i];
+        else if (arg == "--target" && hasValue) config.targetCol = std::atoi(argv[++i]);
+        else if (arg == "--algos" && hasValue) {
+            config.algorithms = splitList(argv[++i]);
+            algosGiven = true;
+        }
+        else if (arg == "--seed" && hasValue) config.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue) config.threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--train-fraction" && hasValue) config.trainFraction = std::atof(argv[++i]);
+        else if (arg == "--save-dir" && hasValue) config.saveDir = argv[++i];
+        else if (arg == "--cv" && hasValue) config.folds = std::atoi(argv[++i]);
+        else if (arg == "--stratified") config.stratified = true;
+        else if (arg == "--lambda" && hasValue) config.params.lambda = std::atof(argv[++i]);
+        else if (arg == "--lr" && hasValue) config.params.lr = std::atof(argv[++i]);
+        else if (arg == "--epochs" && hasValue) config.params.epochs = std::atoi(argv[++i]);
+        else if (arg == "--reg" && hasValue) config.params.reg = std::atof(argv[++i]);
+        else if (arg == "--k" && hasValue) config.params.k = std::atoi(argv[++i]);
+        else if (arg == "--max-depth" && hasValue) config.params.maxDepth = std::atoi(argv[++i]);
+        else if (arg == "--scale" && hasValue) {
+            if (!parseScaleMethod(argv[++i], config.params.scale)) {
+                std::cerr << "Unknown scale method: " << argv[i] << "\n";
+                return false;
+            }
+        }
+        else if (arg == "--sparse") config.sparse = true;
+        else if (arg == "--dedup") config.dedup = true;
+        else if (arg == "--sample" && hasValue) config.sampleRows = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--sample-stratified") config.sampleStratified = true;
+        else if (arg == "--tune" && hasValue) config.tune = argv[++i];
+        else if (arg == "--trials" && hasValue) config.trials = std::strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "Unknown or incomplete option: " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (config.dataPath.empty() || config.targetCol < 0) {
+        std::cerr << "--data and --target are required\n";
+        return false;
+    }
+    if (config.sparse && !algosGiven) config.algorithms = {"linear", "logistic"};
+    if (config.sparse && (!config.saveDir.empty() || config.params.scale != SCALE_NONE ||
+                          config.folds > 1 || !config.tune.empty() || config.dedup ||
+                          config.sampleRows > 0)) {
+        std::cerr << "--sparse cannot be combined with --save-dir, --scale, --cv, --tune, "
+                     "--dedup or --sample\n";
+        return false;
+    }
+    if (config.sampleStratified && config.sampleRows == 0) {
+        std::cerr << "--sample-stratified needs --sample N\n";
+        return false;
+    }
+    if (config.dedup && (config.folds > 1 || !config.tune.empty())) {
+        std::cerr << "--dedup applies to a single train/test split, not --cv or --tune\n";
+        return false;
+    }
+    if (!config.tune.empty() && config.tune != "grid" && config.tune != "random") {
+        std::cerr << "--tune must be grid or random\n";
+        return false;
+    }
+    for (const std::string& a : config.algorithms) {
+        if (!knownAlgorithm(a)) {
+            std::cerr << "Unknown algorithm: " << a << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads the configured file, sampled while parsing when asked to.
+static void loadConfigured(const PipelineConfig& config, bool stats = false) {
+    LoadSampling sampling;
+    sampling.rows = config.sampleRows;
+    sampling.stratified = config.sampleStratified;
+    sampling.seed = config.seed;
+    sampling.stats = stats;
+    loadData(config.dataPath, config.targetCol, sampling);
+}
+
+static std::vector<PipelineResult> runSparsePipeline(const PipelineConfig& config) {
+    std::vector<PipelineResult> results;
+    SparseDataset data;
+    if (!loadSparse(config.dataPath, config.targetCol, data)) return results;
+    SparseSplit split = splitSparse(data, config.trainFraction, config.seed);
+
+    ThreadPool& pool = shared_pool();
+    std::vector<std::future<PipelineResult>> pending;
+    for (const std::string& algo : config.algorithms)
+        pending.push_back(pool.submit([&split, &config, algo]() {
+            return trainAndEvaluateSparse(algo, split, config.params);
+        }));
+
+    for (auto& f : pending)
+        results.push_back(f.get());
+    return results;
+}
+
+std::vector<PipelineResult> runPipeline(const PipelineConfig& config) {
+    if (config.sparse) return runSparsePipeline(config);
+    std::vector<PipelineResult> results;
+
+    // The parse pass only gathers column statistics for a fit on the whole
+    // file; otherwise the scaler comes from the training rows below.
+    loadConfigured(config, config.params.scale != SCALE_NONE && config.trainFraction >= 1.0);
+    if (!dataset.loaded) return results;
+    splitDataset(config.trainFraction, config.seed);
+
+    // Only the training rows are collapsed; every test row is still scored.
+    WeightedSet distinct;
+    if (config.dedup) {
+        distinct = dedupRows(dataset.X_train, dataset.y_train);
+        std::cout << "Collapsed " << dataset.X_train.size() << " training rows into "
+                  << distinct.X.size() << " distinct rows\n";
+    }
+
+    // Held-out rows must not shape the transform they are scored under.
+    Scaler scaler;
+    if (config.params.scale != SCALE_NONE) {
+        if (dataset.X_test.empty() && dataset.stats.count == dataset.X.size()) {
+            scaler = make_scaler(dataset.stats, config.params.scale);
+        } else {
+            std::vector<size_t> trainRows(dataset.X_train.size());
+            std::iota(trainRows.begin(), trainRows.end(), size_t(0));
+            scaler = make_scaler(dataset.X_train, trainRows, config.params.scale);
+        }
+    }
+
+    ThreadPool& pool = shared_pool();
+    std::vector<std::future<PipelineResult>> pending;
+    const Dataset& shared = dataset;
+    const WeightedSet* weighted = config.dedup ? &distinct : nullptr;
+    for (const std::string& algo : config.algorithms)
+        pending.push_back(pool.submit([&shared, weighted, &scaler, &config, algo]() {
+            return trainAndEvaluate(algo, shared, weighted, scaler, config.params, config.saveDir);
+        }));
+
+    for (auto& f : pending)
+        results.push_back(f.get());
+    return results;
+}
+
+std::vector<CVResult> runCrossValidation(const PipelineConfig& config) {
+    loadConfigured(config);
+    if (!dataset.loaded) return {};
+
+    CVConfig cv;
+    cv.folds = config.folds;
+    cv.stratified = config.stratified;
+    cv.seed = config.seed;
+    cv.params = config.params;
+    return cross_validate(dataset.X, dataset.y, config.algorithms, cv);
+}
+
+std::vector<SearchResult> runSearch(const PipelineConfig& config) {
+    loadConfigured(config);
+    if (!dataset.loaded) return {};
+
+    SearchConfig search;
+    search.random = config.tune == "random";
+    search.trials = config.trials;
+    if (config.folds > 1) search.folds = config.folds;
+    search.stratified = config.stratified;
+    search.seed = config.seed;
+    search.base = config.params;
+    return search_hyperparams(dataset.X, dataset.y, config.algorithms, search);
+}
+
+void printPipelineResults(const std::vector<PipelineResult>& results, double wallTime) {
+    double serial = 0.0;
+    std::printf("\n%-10s %12s %12s %10s %10s %10s\n",
+                "algorithm", "train (s)", "predict (s)", "accuracy", "macro-F1", "RMSE");
+    for (const PipelineResult& r : results) {
+        serial += r.trainTime + r.predictTime;
+        if (!r.error.empty()) {
+            std::printf("%-10s failed: %s\n", r.algorithm.c_str(), r.error.c_str());
+            continue;
+        }
+        if (r.regression)
+            std::printf("%-10s %12.6f %12.6f %10s %10s %10.6f\n", r.algorithm.c_str(),
+                        r.trainTime, r.predictTime, "-", "-", r.rmse);
+        else
+            std::printf("%-10s %12.6f %12.6f %9.4f%% %10.6f %10s\n", r.algorithm.c_str(),
+                        r.trainTime, r.predictTime, r.accuracy * 100.0, r.macroF1, "-");
+    }
+    std::printf("\nWall time: %.6f s (sum of model times: %.6f s)\n", wallTime, serial);
+}
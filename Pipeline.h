@@ -0,0 +1,61 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CrossValidation.h"
+#include "Hyperparams.h"
+#include "Tuning.h"
+
+// Non-interactive batch run: load once, split once, then train and score
+// every selected algorithm concurrently against the shared read-only split.
+struct PipelineConfig {
+    std::string dataPath;
+    int targetCol = -1;
+    std::vector<std::string> algorithms = {"linear", "logistic", "knn", "tree", "gnb"};
+    uint64_t seed = 42;
+    size_t threads = 0;          // 0 = hardware threads; see set_num_threads
+    double trainFraction = 0.8;
+    std::string saveDir;         // if set, each trained model is written to <dir>/<algo>.model
+    int folds = 0;               // > 1 = k-fold cross-validation instead of one split
+    bool stratified = false;
+    Hyperparams params;
+    std::string tune;            // "grid" or "random": search params instead of training
+    size_t trials = 20;          // random search: candidates per algorithm
+    bool sparse = false;         // one-hot CSR input; linear and logistic only
+    bool dedup = false;          // fit on distinct training rows with counts as weights
+    size_t sampleRows = 0;       // > 0 = keep a seeded sample of this many rows while loading
+    bool sampleStratified = false;   // sample each class in proportion
+};
+
+struct PipelineResult {
+    std::string algorithm;
+    bool regression = false;
+    double trainTime = 0.0;
+    double predictTime = 0.0;
+    double accuracy = 0.0;
+    double macroF1 = 0.0;
+    double rmse = 0.0;
+    std::string error;
+};
+
+// Returns false and prints usage when the arguments are invalid.
+bool parsePipelineArgs(int argc, char** argv, PipelineConfig& config);
+
+void printPipelineUsage(const char* prog);
+
+std::vector<PipelineResult> runPipeline(const PipelineConfig& config);
+
+// Loads the data and cross-validates every selected algorithm; used when
+// config.folds > 1.
+std::vector<CVResult> runCrossValidation(const PipelineConfig& config);
+
+// Loads the data and searches hyperparameters by cross-validation (folds
+// default to 3); used when config.tune is set.
+std::vector<SearchResult> runSearch(const PipelineConfig& config);
+
+void printPipelineResults(const std::vector<PipelineResult>& results, double wallTime);
+
+#endif
@@ -8,7 +8,6 @@
 #include <iostream>
 #include <vector>
 #include <string>
-#include <chrono>
 #include <iomanip>
 
 #include "loadData.h"
@@ -17,6 +16,14 @@
 #include "KNN.h"
 #include "DecisionTree.h"
 #include "GaussianNB.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include "MemTrack.h"
+#include "Hyperparams.h"
+#include "Pipeline.h"
+#include "Parallel.h"
+#include "Kernels.h"
+#include "Server.h"
 
 enum AlgorithmType { NONE, LINEAR, LOGISTIC, KNN_ALGO, TREE, NB };
 AlgorithmType lastTrainedAlgo = NONE;
@@ -27,6 +34,7 @@ LogisticModel logistic_model;
 KNNModel knn_model;
 DecisionTreeModel tree_model;
 GaussianNBModel gnb_model;
+Hyperparams params;
 
 static std::vector<double> ints_to_doubles(const std::vector<int>& v) {
     return std::vector<double>(v.begin(), v.end());
@@ -37,7 +45,11 @@ void printResults() {
     switch (lastTrainedAlgo) {
         case LINEAR: {
             std::vector<double> y_test_d = ints_to_doubles(dataset.y_test);
-            std::vector<double> y_pred = predict_linear(linear_model, dataset.X_test);
+            std::vector<double> y_pred;
+            {
+                MEM_STAGE("predict.linear");
+                y_pred = predict_linear(linear_model, dataset.X_test);
+            }
             double rmse = computeRMSE(y_test_d, y_pred);
             std::cout << "Algorithm: Linear Regression\n";
             std::cout << "Training Time: " << std::fixed << std::setprecision(6) << lastTrainTime << " seconds\n";
@@ -45,9 +57,14 @@ void printResults() {
             break;
         }
         case LOGISTIC: {
-            std::vector<int> y_pred = predict_logistic(logistic_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.logistic");
+                y_pred = predict_logistic(logistic_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Algorithm: Logistic Regression\n";
             std::cout << "Training Time: " << std::fixed << std::setprecision(6) << lastTrainTime << " seconds\n";
             std::cout << "Test Accuracy: " << acc * 100.0 << "%\n";
@@ -55,9 +72,14 @@ void printResults() {
             break;
         }
         case KNN_ALGO: {
-            std::vector<int> y_pred = predict_knn(knn_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_knn(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.knn");
+                y_pred = predict_knn(knn_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Algorithm: k-Nearest Neighbors\n";
             std::cout << "Training Time: " << std::fixed << std::setprecision(6) << lastTrainTime << " seconds\n";
             std::cout << "Test Accuracy: " << acc * 100.0 << "%\n";
@@ -65,9 +87,14 @@ void printResults() {
             break;
         }
         case TREE: {
-            std::vector<int> y_pred = predict_tree(tree_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_tree(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.tree");
+                y_pred = predict_tree(tree_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Algorithm: Decision Tree (ID3)\n";
             std::cout << "Training Time: " << std::fixed << std::setprecision(6) << lastTrainTime << " seconds\n";
             std::cout << "Test Accuracy: " << acc * 100.0 << "%\n";
@@ -75,9 +102,14 @@ void printResults() {
             break;
         }
         case NB: {
-            std::vector<int> y_pred = predict_gnb(gnb_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_gnb(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.gnb");
+                y_pred = predict_gnb(gnb_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Algorithm: Gaussian Naive Bayes\n";
             std::cout << "Training Time: " << std::fixed << std::setprecision(6) << lastTrainTime << " seconds\n";
             std::cout << "Test Accuracy: " << acc * 100.0 << "%\n";
@@ -91,7 +123,90 @@ void printResults() {
     std::cout << "===========================================\n\n";
 }
 
-int main() {
+// Batch mode: any command-line argument skips the menu
+static int runBatch(int argc, char** argv) {
+    PipelineConfig config;
+    std::string first = argv[1];
+    if (first == "--help" || first == "-h") {
+        printPipelineUsage(argv[0]);
+        return 0;
+    }
+    if (!parsePipelineArgs(argc, argv, config)) {
+        printPipelineUsage(argv[0]);
+        return 1;
+    }
+    set_num_threads(config.threads);
+
+    double wallTime = 0.0;
+    if (!config.tune.empty()) {
+        std::vector<SearchResult> results;
+        {
+            ScopedTimer timer("pipeline", &wallTime);
+            results = runSearch(config);
+        }
+        if (results.empty()) return 1;
+
+        printSearchResults(results, wallTime);
+        profile_dump();
+        memtrack_dump();
+        return 0;
+    }
+    if (config.folds > 1) {
+        std::vector<CVResult> results;
+        {
+            ScopedTimer timer("pipeline", &wallTime);
+            results = runCrossValidation(config);
+        }
+        if (results.empty()) return 1;
+
+        printCVResults(results, wallTime);
+        profile_dump();
+        memtrack_dump();
+        return 0;
+    }
+
+    std::vector<PipelineResult> results;
+    {
+        ScopedTimer timer("pipeline", &wallTime);
+        results = runPipeline(config);
+    }
+    if (results.empty()) return 1;
+
+    printPipelineResults(results, wallTime);
+    profile_dump();
+    memtrack_dump();
+    return 0;
+}
+
+static int runServing(int argc, char** argv) {
+    std::string mode = argv[1];
+    if (mode == "--serve") {
+        ServerConfig config;
+        if (!parseServerArgs(argc, argv, config)) {
+            printServerUsage(argv[0]);
+            return 1;
+        }
+        return runServer(config);
+    }
+
+    LoadGenConfig config;
+    if (!parseLoadGenArgs(argc, argv, config)) {
+        printServerUsage(argv[0]);
+        return 1;
+    }
+    return runLoadGenerator(config);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        std::string mode = argv[1];
+        if (mode == "--serve" || mode == "--loadgen")
+            return runServing(argc, argv);
+        if (mode == "--selftest")
+            return kernel_selftest() ? 0 : 1;
+        return runBatch(argc, argv);
+    }
+
     while (true) {
         std::cout << "======================================\n";
         std::cout << "  C++ Procedural ML Project\n";
@@ -117,8 +232,14 @@ int main() {
             std::string filename;
             std::cout << "Enter CSV filename: ";
             std::cin >> filename;
-            loadData(filename);
-            splitDataset();
+            {
+                MEM_STAGE("load");
+                loadData(filename);
+            }
+            {
+                MEM_STAGE("split");
+                splitDataset();
+            }
             std::cout << "Loaded " << dataset.X.size() << " samples.\n";
             if (!dataset.X.empty()) 
                 std::cout << "Feature count: " << dataset.X[0].size() << "\n";
@@ -130,16 +251,21 @@ int main() {
             }
             
             std::vector<double> y_train_d = ints_to_doubles(dataset.y_train);
-            std::cout << "Training Linear Regression (closed-form, L2 lambda=0.1)...\n";
+            std::cout << "Training Linear Regression (closed-form, L2 lambda=" << params.lambda << ")...\n";
             
-            auto t0 = std::chrono::high_resolution_clock::now();
-            linear_model = fit_linear(dataset.X_train, y_train_d, 0.1);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            lastTrainTime = std::chrono::duration<double>(t1 - t0).count();
+            {
+                ScopedTimer timer("train.linear", &lastTrainTime);
+                MEM_STAGE("fit.linear");
+                linear_model = fit_linear(dataset.X_train, y_train_d, params.lambda);
+            }
             lastTrainedAlgo = LINEAR;
             
             std::vector<double> y_test_d = ints_to_doubles(dataset.y_test);
-            std::vector<double> y_pred = predict_linear(linear_model, dataset.X_test);
+            std::vector<double> y_pred;
+            {
+                MEM_STAGE("predict.linear");
+                y_pred = predict_linear(linear_model, dataset.X_test);
+            }
             double rmse = computeRMSE(y_test_d, y_pred);
             std::cout << "Linear Regression RMSE: " << rmse << "\n";
             std::cout << "Training time: " << lastTrainTime << " seconds\n";
@@ -151,15 +277,21 @@ int main() {
             }
             
             std::cout << "Training Logistic Regression (GD, L2 optional)...\n";
-            auto t0 = std::chrono::high_resolution_clock::now();
-            logistic_model = fit_logistic(dataset.X_train, dataset.y_train, 0.01, 100, 0.0);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            lastTrainTime = std::chrono::duration<double>(t1 - t0).count();
+            {
+                ScopedTimer timer("train.logistic", &lastTrainTime);
+                MEM_STAGE("fit.logistic");
+                logistic_model = fit_logistic(dataset.X_train, dataset.y_train, params.lr, params.epochs, params.reg);
+            }
             lastTrainedAlgo = LOGISTIC;
             
-            std::vector<int> y_pred = predict_logistic(logistic_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.logistic");
+                y_pred = predict_logistic(logistic_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Logistic Accuracy: " << acc * 100.0 << "%\n";
             std::cout << "Macro-F1: " << f1 << "\n";
             std::cout << "Training time: " << lastTrainTime << " seconds\n";
@@ -170,17 +302,23 @@ int main() {
                 continue; 
             }
             
-            int k = 5;
+            int k = params.k;
             std::cout << "Training k-NN (k=" << k << ")...\n";
-            auto t0 = std::chrono::high_resolution_clock::now();
-            knn_model = fit_knn(dataset.X_train, dataset.y_train, k);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            lastTrainTime = std::chrono::duration<double>(t1 - t0).count();
+            {
+                ScopedTimer timer("train.knn", &lastTrainTime);
+                MEM_STAGE("fit.knn");
+                knn_model = fit_knn(dataset.X_train, dataset.y_train, k);
+            }
             lastTrainedAlgo = KNN_ALGO;
             
-            std::vector<int> y_pred = predict_knn(knn_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_knn(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.knn");
+                y_pred = predict_knn(knn_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "KNN Accuracy: " << acc * 100.0 << "%\n";
             std::cout << "Macro-F1: " << f1 << "\n";
             std::cout << "Training time: " << lastTrainTime << " seconds\n";
@@ -192,15 +330,21 @@ int main() {
             }
             
             std::cout << "Training Decision Tree (ID3)...\n";
-            auto t0 = std::chrono::high_resolution_clock::now();
-            tree_model = fit_tree(dataset.X_train, dataset.y_train);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            lastTrainTime = std::chrono::duration<double>(t1 - t0).count();
+            {
+                ScopedTimer timer("train.tree", &lastTrainTime);
+                MEM_STAGE("fit.tree");
+                tree_model = fit_tree(dataset.X_train, dataset.y_train, params.maxDepth);
+            }
             lastTrainedAlgo = TREE;
             
-            std::vector<int> y_pred = predict_tree(tree_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_tree(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.tree");
+                y_pred = predict_tree(tree_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "Decision Tree Accuracy: " << acc * 100.0 << "%\n";
             std::cout << "Macro-F1: " << f1 << "\n";
             std::cout << "Training time: " << lastTrainTime << " seconds\n";
@@ -212,15 +356,21 @@ int main() {
             }
             
             std::cout << "Training Gaussian Naive Bayes...\n";
-            auto t0 = std::chrono::high_resolution_clock::now();
-            gnb_model = fit_gnb(dataset.X_train, dataset.y_train);
-            auto t1 = std::chrono::high_resolution_clock::now();
-            lastTrainTime = std::chrono::duration<double>(t1 - t0).count();
+            {
+                ScopedTimer timer("train.gnb", &lastTrainTime);
+                MEM_STAGE("fit.gnb");
+                gnb_model = fit_gnb(dataset.X_train, dataset.y_train);
+            }
             lastTrainedAlgo = NB;
             
-            std::vector<int> y_pred = predict_gnb(gnb_model, dataset.X_test);
-            double acc = computeAccuracy(dataset.y_test, y_pred);
-            double f1 = macroF1_gnb(dataset.y_test, y_pred);
+            std::vector<int> y_pred;
+            {
+                MEM_STAGE("predict.gnb");
+                y_pred = predict_gnb(gnb_model, dataset.X_test);
+            }
+            ConfusionMatrix cm = confusion_matrix(dataset.y_test, y_pred);
+            double acc = cm.accuracy();
+            double f1 = cm.macroF1();
             std::cout << "GNB Accuracy: " << acc * 100.0 << "%\n";
             std::cout << "Macro-F1: " << f1 << "\n";
             std::cout << "Training time: " << lastTrainTime << " seconds\n";
@@ -230,6 +380,8 @@ int main() {
         }
         else if (choice == 8) {
             std::cout << "Quitting.\n";
+            profile_dump();
+            memtrack_dump();
             break;
         }
         else {
@@ -0,0 +1,180 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef ML_PROFILE
+
+namespace {
+
+struct Span {
+    const char* name;
+    long index;
+    uint64_t start_ns;
+    uint64_t dur_ns;
+};
+
+struct SpanStats {
+    uint64_t calls = 0;
+    uint64_t total_ns = 0;
+    uint64_t min_ns = UINT64_MAX;
+    uint64_t max_ns = 0;
+};
+
+using Key = std::pair<const char*, long>;
+
+// Each thread writes only to its own buffer; the registry keeps buffers
+// alive after their thread exits so dump() can still read them.
+struct ThreadBuffer {
+    int tid = 0;
+    std::mutex lock;   // uncontended except while dumping
+    std::vector<Span> spans;
+    std::map<Key, SpanStats> stats;
+    std::map<Key, uint64_t> counters;
+};
+
+const size_t kMaxTraceSpans = 1 << 20;   // per thread; aggregates keep counting past it
+
+std::mutex registry_lock;
+std::vector<std::shared_ptr<ThreadBuffer>> registry;
+uint64_t epoch_ns = profile_now_ns();
+
+ThreadBuffer& local_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buf;
+    if (!buf) {
+        buf = std::make_shared<ThreadBuffer>();
+        std::lock_guard<std::mutex> g(registry_lock);
+        buf->tid = static_cast<int>(registry.size());
+        registry.push_back(buf);
+    }
+    return *buf;
+}
+
+std::string key_name(const std::pair<std::string, long>& k) {
+    return k.second < 0 ? k.first : k.first + "[" + std::to_string(k.second) + "]";
+}
+
+}  // namespace
+
+void profile_record_span(const char* name, long index, uint64_t start_ns, uint64_t dur_ns) {
+    ThreadBuffer& buf = local_buffer();
+    std::lock_guard<std::mutex> g(buf.lock);
+    SpanStats& s = buf.stats[Key(name, index)];
+    s.calls++;
+    s.total_ns += dur_ns;
+    if (dur_ns < s.min_ns) s.min_ns = dur_ns;
+    if (dur_ns > s.max_ns) s.max_ns = dur_ns;
+    if (buf.spans.size() < kMaxTraceSpans)
+        buf.spans.push_back({name, index, start_ns, dur_ns});
+}
+
+void profile_count(const char* name, long index, uint64_t n) {
+    ThreadBuffer& buf = local_buffer();
+    std::lock_guard<std::mutex> g(buf.lock);
+    buf.counters[Key(name, index)] += n;
+}
+
+bool profile_write_report(const std::string& path) {
+    // Merge by name text: the same literal may live at several addresses
+    std::map<std::pair<std::string, long>, SpanStats> spans;
+    std::map<std::pair<std::string, long>, uint64_t> counters;
+    {
+        std::lock_guard<std::mutex> g(registry_lock);
+        for (auto& buf : registry) {
+            std::lock_guard<std::mutex> bg(buf->lock);
+            for (auto& kv : buf->stats) {
+                SpanStats& s = spans[{kv.first.first, kv.first.second}];
+                s.calls += kv.second.calls;
+                s.total_ns += kv.second.total_ns;
+                s.min_ns = std::min(s.min_ns, kv.second.min_ns);
+                s.max_ns = std::max(s.max_ns, kv.second.max_ns);
+            }
+            for (auto& kv : buf->counters)
+                counters[{kv.first.first, kv.first.second}] += kv.second;
+        }
+    }
+
+    std::ofstream f(path);
+    if (!f.is_open()) return false;
+
+    f << "{\n  \"timers\": [\n";
+    size_t i = 0;
+    for (auto& kv : spans) {
+        const SpanStats& s = kv.second;
+        f << "    {\"name\": \"" << key_name(kv.first) << "\", \"calls\": " << s.calls
+          << ", \"total_s\": " << s.total_ns * 1e-9
+          << ", \"mean_s\": " << (s.calls ? s.total_ns * 1e-9 / s.calls : 0.0)
+          << ", \"min_s\": " << s.min_ns * 1e-9
+          << ", \"max_s\": " << s.max_ns * 1e-9 << "}"
+          << (++i < spans.size() ? ",\n" : "\n");
+    }
+    f << "  ],\n  \"counters\": [\n";
+    i = 0;
+    for (auto& kv : counters) {
+        f << "    {\"name\": \"" << key_name(kv.first) << "\", \"value\": " << kv.second << "}"
+          << (++i < counters.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+    return true;
+}
+
+bool profile_write_trace(const std::string& path) {
+    std::ofstream f(path);
+    if (!f.is_open()) return false;
+
+    f << "{\"traceEvents\": [\n";
+    bool first = true;
+    std::lock_guard<std::mutex> g(registry_lock);
+    for (auto& buf : registry) {
+        std::lock_guard<std::mutex> bg(buf->lock);
+        for (const Span& s : buf->spans) {
+            f << (first ? "" : ",\n")
+              << "{\"name\": \"" << key_name({s.name, s.index}) << "\", \"ph\": \"X\", \"pid\": 1"
+              << ", \"tid\": " << buf->tid
+              << ", \"ts\": " << (s.start_ns - epoch_ns) / 1000.0
+              << ", \"dur\": " << s.dur_ns / 1000.0 << "}";
+            first = false;
+        }
+    }
+    f << "\n]}\n";
+    return true;
+}
+
+void profile_reset() {
+    std::lock_guard<std::mutex> g(registry_lock);
+    for (auto& buf : registry) {
+        std::lock_guard<std::mutex> bg(buf->lock);
+        buf->spans.clear();
+        buf->stats.clear();
+        buf->counters.clear();
+    }
+}
+
+void profile_dump() {
+    const char* report = std::getenv("ML_PROFILE_OUT");
+    std::string path = report ? report : "profile_report.json";
+    if (profile_write_report(path))
+        std::cout << "Profile report written to " << path << "\n";
+
+    if (const char* trace = std::getenv("ML_TRACE_OUT")) {
+        if (profile_write_trace(trace))
+            std::cout << "Trace written to " << trace << "\n";
+    }
+}
+
+#else
+
+void profile_record_span(const char*, long, uint64_t, uint64_t) {}
+void profile_count(const char*, long, uint64_t) {}
+bool profile_write_report(const std::string&) { return false; }
+bool profile_write_trace(const std::string&) { return false; }
+void profile_reset() {}
+void profile_dump() {}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Phase timers and counters. Build with -DML_PROFILE (make PROFILE=1) to
+// record them; otherwise the PROFILE_* macros compile to nothing.
+//
+// profile_dump() writes the aggregated report to $ML_PROFILE_OUT
+// (default profile_report.json) and, if $ML_TRACE_OUT is set, a Chrome
+// trace (chrome://tracing, Perfetto) of every recorded span.
+
+void profile_record_span(const char* name, long index, uint64_t start_ns, uint64_t dur_ns);
+void profile_count(const char* name, long index, uint64_t n);
+bool profile_write_report(const std::string& path);
+bool profile_write_trace(const std::string& path);
+void profile_reset();
+void profile_dump();
+
+inline uint64_t profile_now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Times the enclosing scope. Always measures so callers can read the
+// elapsed seconds through `out`; only records a span when profiling is on.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char* name, double* out = nullptr, long index = -1)
+        : name_(name), index_(index), out_(out), start_(profile_now_ns()) {}
+
+    ~ScopedTimer() {
+        uint64_t dur = profile_now_ns() - start_;
+        if (out_) *out_ = dur * 1e-9;
+#ifdef ML_PROFILE
+        profile_record_span(name_, index_, start_, dur);
+#endif
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    const char* name_;
+    long index_;
+    double* out_;
+    uint64_t start_;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef ML_PROFILE
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_SCOPE_N(name, index) \
+    ScopedTimer PROFILE_CONCAT(profile_scope_, __LINE__)(name, nullptr, (index))
+#define PROFILE_COUNT(name, n) profile_count(name, -1, (n))
+#define PROFILE_COUNT_N(name, index, n) profile_count(name, (index), (n))
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_SCOPE_N(name, index) ((void)0)
+#define PROFILE_COUNT(name, n) ((void)0)
+#define PROFILE_COUNT_N(name, index, n) ((void)0)
+#endif
+
+#endif
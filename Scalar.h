@@ -0,0 +1,59 @@
+#ifndef SCALAR_H
+#define SCALAR_H
+
+#include "Kernels.h"
+#include <cstddef>
+#include <vector>
+
+// Models and kernels are templated on the feature scalar type and
+// instantiated for float and double. double is what the loader produces
+// and what the rest of the tree uses; float halves the bytes streamed per
+// row and doubles the lanes per SIMD register.
+//
+// Reductions that feed a solver or a variance (X^T X, class moments) are
+// always accumulated in double; only per-row kernels run in T.
+template <typename T>
+using Matrix = std::vector<std::vector<T>>;
+
+template <typename T, typename U>
+Matrix<T> cast_matrix(const Matrix<U>& X) {
+    Matrix<T> out(X.size());
+    for (size_t i = 0; i < X.size(); ++i)
+        out[i].assign(X[i].begin(), X[i].end());
+    return out;
+}
+
+template <typename T, typename U>
+std::vector<T> cast_vector(const std::vector<U>& v) {
+    return std::vector<T>(v.begin(), v.end());
+}
+
+// Per-row kernels, dispatched to the instruction set picked at startup
+// (Kernels.h). Every variant sums in the same fixed lane order, so results
+// do not depend on which CPU the binary lands on.
+inline double dot_n(const double* a, const double* b, size_t n) {
+    return kernels().dot_f64(a, b, n);
+}
+
+inline float dot_n(const float* a, const float* b, size_t n) {
+    return kernels().dot_f32(a, b, n);
+}
+
+inline double sqdist_n(const double* a, const double* b, size_t n) {
+    return kernels().sqdist_f64(a, b, n);
+}
+
+inline float sqdist_n(const float* a, const float* b, size_t n) {
+    return kernels().sqdist_f32(a, b, n);
+}
+
+// sum w[i] * (a[i] - b[i])^2
+inline double wsqdist_n(const double* a, const double* b, const double* w, size_t n) {
+    return kernels().wsqdist_f64(a, b, w, n);
+}
+
+inline float wsqdist_n(const float* a, const float* b, const float* w, size_t n) {
+    return kernels().wsqdist_f32(a, b, w, n);
+}
+
+#endif
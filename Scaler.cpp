@@ -0,0 +1,175 @@
+#include "Scaler.h"
+#include <algorithm>
+#include <cmath>
+
+const char* scaleMethodName(ScaleMethod method) {
+    switch (method) {
+        case SCALE_STANDARD: return "standard";
+        case SCALE_MINMAX: return "minmax";
+        case SCALE_ROBUST: return "robust";
+        default: return "none";
+    }
+}
+
+bool parseScaleMethod(const std::string& name, ScaleMethod& method) {
+    if (name == "none") method = SCALE_NONE;
+    else if (name == "standard") method = SCALE_STANDARD;
+    else if (name == "minmax") method = SCALE_MINMAX;
+    else if (name == "robust") method = SCALE_ROBUST;
+    else return false;
+    return true;
+}
+
+P2Quantile::P2Quantile(double p) : p_(p) {
+    want_[0] = 0.0;
+    want_[1] = 2.0 * p;
+    want_[2] = 4.0 * p;
+    want_[3] = 2.0 + 2.0 * p;
+    want_[4] = 4.0;
+    step_[0] = 0.0;
+    step_[1] = p / 2.0;
+    step_[2] = p;
+    step_[3] = (1.0 + p) / 2.0;
+    step_[4] = 1.0;
+}
+
+void P2Quantile::add(double x) {
+    if (count_ < 5) {
+        q_[count_++] = x;
+        if (count_ == 5) {
+            std::sort(q_, q_ + 5);
+            for (int i = 0; i < 5; ++i) n_[i] = i;
+        }
+        return;
+    }
+    ++count_;
+
+    int k;
+    if (x < q_[0]) {
+        q_[0] = x;
+        k = 0;
+    } else if (x >= q_[4]) {
+        q_[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (k < 3 && x >= q_[k + 1]) ++k;
+    }
+    for (int i = k + 1; i < 5; ++i) n_[i] += 1.0;
+    for (int i = 0; i < 5; ++i) want_[i] += step_[i];
+
+    // Nudge the middle markers toward their desired positions
+    for (int i = 1; i < 4; ++i) {
+        double d = want_[i] - n_[i];
+        if ((d >= 1.0 && n_[i + 1] - n_[i] > 1.0) || (d <= -1.0 && n_[i - 1] - n_[i] < -1.0)) {
+            double s = d > 0 ? 1.0 : -1.0;
+            double qp = q_[i] + s / (n_[i + 1] - n_[i - 1]) *
+                        ((n_[i] - n_[i - 1] + s) * (q_[i + 1] - q_[i]) / (n_[i + 1] - n_[i]) +
+                         (n_[i + 1] - n_[i] - s) * (q_[i] - q_[i - 1]) / (n_[i] - n_[i - 1]));
+            if (q_[i - 1] < qp && qp < q_[i + 1]) {
+                q_[i] = qp;
+            } else {
+                int j = i + int(s);
+                q_[i] += s * (q_[j] - q_[i]) / (n_[j] - n_[i]);
+            }
+            n_[i] += s;
+        }
+    }
+}
+
+double P2Quantile::value() const {
+    if (count_ == 0) return 0.0;
+    if (count_ >= 5) return q_[2];
+    double v[5];
+    std::copy(q_, q_ + count_, v);
+    std::sort(v, v + count_);
+    return v[size_t(std::lround(p_ * (count_ - 1)))];
+}
+
+void FeatureStats::clear() {
+    *this = FeatureStats();
+}
+
+void FeatureStats::add(const std::vector<double>& row) {
+    if (count == 0) {
+        size_t d = row.size();
+        mean.assign(d, 0.0);
+        m2.assign(d, 0.0);
+        min = row;
+        max = row;
+        q1.assign(d, P2Quantile(0.25));
+        median.assign(d, P2Quantile(0.5));
+        q3.assign(d, P2Quantile(0.75));
+        distinct.assign(d, {});
+        exact.assign(d, true);
+    }
+    ++count;
+    size_t d = std::min(row.size(), mean.size());
+    for (size_t j = 0; j < d; ++j) {
+        double x = row[j];
+        double delta = x - mean[j];
+        mean[j] += delta / count;
+        m2[j] += delta * (x - mean[j]);
+        min[j] = std::min(min[j], x);
+        max[j] = std::max(max[j], x);
+        q1[j].add(x);
+        median[j].add(x);
+        q3[j].add(x);
+        if (exact[j]) {
+            distinct[j][x]++;
+            if (distinct[j].size() > kMaxDistinct) {
+                distinct[j].clear();
+                exact[j] = false;
+            }
+        }
+    }
+}
+
+double FeatureStats::stddev(size_t j) const {
+    return count ? std::sqrt(m2[j] / count) : 0.0;
+}
+
+double FeatureStats::quantile(size_t j, double p) const {
+    if (!exact[j]) return p < 0.5 ? q1[j].value() : p > 0.5 ? q3[j].value() : median[j].value();
+
+    // Lower nearest rank, the value at sorted position floor(p * (count - 1))
+    size_t target = size_t(p * (count - 1));
+    size_t seen = 0;
+    for (const auto& v : distinct[j]) {
+        seen += v.second;
+        if (seen > target) return v.first;
+    }
+    return max[j];
+}
+
+Scaler make_scaler(const FeatureStats& stats, ScaleMethod method) {
+    Scaler s;
+    if (method == SCALE_NONE || stats.count == 0) return s;
+    s.method = method;
+    size_t d = stats.mean.size();
+    s.shift.resize(d);
+    s.scale.resize(d);
+    for (size_t j = 0; j < d; ++j) {
+        double spread;
+        if (method == SCALE_STANDARD) {
+            s.shift[j] = stats.mean[j];
+            spread = stats.stddev(j);
+        } else if (method == SCALE_MINMAX) {
+            s.shift[j] = stats.min[j];
+            spread = stats.max[j] - stats.min[j];
+        } else {
+            s.shift[j] = stats.quantile(j, 0.5);
+            spread = stats.quantile(j, 0.75) - stats.quantile(j, 0.25);
+        }
+        s.scale[j] = spread > 0.0 ? 1.0 / spread : 1.0;
+    }
+    return s;
+}
+
+Scaler make_scaler(const std::vector<std::vector<double>>& X,
+                   const std::vector<size_t>& rows, ScaleMethod method) {
+    if (method == SCALE_NONE) return Scaler();
+    FeatureStats stats;
+    for (size_t r : rows) stats.add(X[r]);
+    return make_scaler(stats, method);
+}
@@ -0,0 +1,80 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+enum ScaleMethod {
+    SCALE_NONE = 0,
+    SCALE_STANDARD = 1,   // (x - mean) / stddev
+    SCALE_MINMAX = 2,     // (x - min) / (max - min)
+    SCALE_ROBUST = 3,     // (x - median) / (q3 - q1)
+};
+
+const char* scaleMethodName(ScaleMethod method);
+bool parseScaleMethod(const std::string& name, ScaleMethod& method);
+
+// Streaming estimate of one quantile in O(1) memory (Jain & Chlamtac P²).
+// Exact for the first five observations.
+class P2Quantile {
+public:
+    explicit P2Quantile(double p = 0.5);
+    void add(double x);
+    double value() const;
+
+private:
+    double p_;
+    size_t count_ = 0;
+    double q_[5];      // marker heights
+    double n_[5];      // marker positions
+    double want_[5];   // desired positions
+    double step_[5];   // desired position increments
+};
+
+// Per-column statistics gathered one row at a time while the CSV is parsed,
+// so no extra pass over the data is needed to build any scaler. Quantiles
+// are exact while a column has at most kMaxDistinct values (coded and
+// integer columns); past that they come from P² estimators, which lose
+// accuracy on heavily tied columns.
+struct FeatureStats {
+    static const size_t kMaxDistinct = 1024;
+
+    size_t count = 0;
+    std::vector<double> mean;
+    std::vector<double> m2;
+    std::vector<double> min;
+    std::vector<double> max;
+    std::vector<P2Quantile> q1;
+    std::vector<P2Quantile> median;
+    std::vector<P2Quantile> q3;
+    std::vector<std::map<double, size_t>> distinct;   // emptied once over the cap
+    std::vector<bool> exact;
+
+    void clear();
+    void add(const std::vector<double>& row);
+    double stddev(size_t j) const;
+    double quantile(size_t j, double p) const;   // p in {0.25, 0.5, 0.75}
+};
+
+// Affine per-feature transform x' = (x - shift) * scale. Columns with zero
+// spread get scale 1. Models fold it into their parameters or kernels, so
+// rows are never rewritten.
+struct Scaler {
+    ScaleMethod method = SCALE_NONE;
+    std::vector<double> shift;
+    std::vector<double> scale;
+
+    bool active() const { return method != SCALE_NONE && !scale.empty(); }
+    double apply(size_t j, double x) const { return (x - shift[j]) * scale[j]; }
+};
+
+Scaler make_scaler(const FeatureStats& stats, ScaleMethod method);
+
+// Built from the listed rows of X only, e.g. the training rows of a fold,
+// so held-out rows do not shape the transform they are scored under.
+Scaler make_scaler(const std::vector<std::vector<double>>& X,
+                   const std::vector<size_t>& rows, ScaleMethod method);
+
+#endif
@@ -0,0 +1,586 @@
+#include "Server.h"
+#include "loadData.h"
+#include "Parallel.h"
+#include "Kernels.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+std::atomic<bool> g_stop(false);
+
+void onSignal(int) {
+    g_stop = true;
+}
+
+bool parseRow(const std::string& line, std::vector<double>& row) {
+    row.clear();
+    const char* p = line.c_str();
+    while (*p) {
+        char* end = nullptr;
+        double v = std::strtod(p, &end);
+        if (end == p) return false;
+        row.push_back(v);
+        p = end;
+        while (*p == ' ' || *p == '\r') ++p;
+        if (*p == ',') ++p;
+        else if (*p) return false;
+    }
+    return !row.empty();
+}
+
+// "INSERT label,v1,...,vn" or "DELETE id" against a served k-NN index.
+std::string applyUpdate(const std::string& line, const ServedModel& model) {
+    std::vector<double> row;
+    if (model.kind != MODEL_KNN) return "ERR updates need a k-NN model";
+    if (line.compare(0, 7, "INSERT ") == 0) {
+        if (!parseRow(line.substr(7), row)) return "ERR malformed row";
+        if (row.size() != model.features + 1)
+            return "ERR expected a label and " + std::to_string(model.features) + " features";
+        if (std::floor(row[0]) != row[0] || std::fabs(row[0]) > 1e9)
+            return "ERR label must be an integer";
+        int label = static_cast<int>(row[0]);
+        row.erase(row.begin());
+        return "OK " + std::to_string(model.knn->insert(row, label));
+    }
+    char* end = nullptr;
+    unsigned long long id = std::strtoull(line.c_str() + 7, &end, 10);
+    if (end == line.c_str() + 7 || *end) return "ERR malformed id";
+    return model.knn->erase(id) ? "OK" : "ERR unknown id";
+}
+
+std::string formatPrediction(ModelKind kind, double v) {
+    char buf[64];
+    if (kind == MODEL_LINEAR) std::snprintf(buf, sizeof(buf), "%.9g", v);
+    else std::snprintf(buf, sizeof(buf), "%d", static_cast<int>(v));
+    return buf;
+}
+
+// Latencies of the most recent requests (bounded ring) plus totals.
+class LatencyStats {
+public:
+    void record(double seconds) {
+        std::lock_guard<std::mutex> g(lock_);
+        if (samples_.size() < kMaxSamples) samples_.push_back(seconds);
+        else samples_[count_ % kMaxSamples] = seconds;
+        ++count_;
+    }
+
+    void recordBatch(size_t rows) {
+        std::lock_guard<std::mutex> g(lock_);
+        ++batches_;
+        batchRows_ += rows;
+    }
+
+    std::string json() const {
+        std::vector<double> s;
+        size_t count, batches, batchRows;
+        {
+            std::lock_guard<std::mutex> g(lock_);
+            s = samples_;
+            count = count_;
+            batches = batches_;
+            batchRows = batchRows_;
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start_).count();
+        std::sort(s.begin(), s.end());
+        auto pct = [&](double q) {
+            return s.empty() ? 0.0 : s[std::min(s.size() - 1, size_t(q * (s.size() - 1) + 0.5))];
+        };
+
+        char buf[320];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"requests\": %zu, \"batches\": %zu, \"mean_batch\": %.2f, "
+                      "\"p50_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f, \"throughput_rps\": %.1f}",
+                      count, batches, batches ? double(batchRows) / batches : 0.0,
+                      pct(0.50) * 1e3, pct(0.99) * 1e3, s.empty() ? 0.0 : s.back() * 1e3,
+                      elapsed > 0 ? count / elapsed : 0.0);
+        return buf;
+    }
+
+private:
+    static const size_t kMaxSamples = 1 << 20;
+    mutable std::mutex lock_;
+    std::vector<double> samples_;
+    size_t count_ = 0;
+    size_t batches_ = 0;
+    size_t batchRows_ = 0;
+    Clock::time_point start_ = Clock::now();
+};
+
+struct Request {
+    std::vector<double> row;
+    std::promise<double> result;
+    Clock::time_point enqueued;
+};
+
+// Coalesces queued requests into micro-batches scored on a worker pool.
+class MicroBatcher {
+public:
+    MicroBatcher(const ServedModel& model, const ServerConfig& config, LatencyStats& stats)
+        : model_(model), maxBatch_(std::max<size_t>(1, config.maxBatch)),
+          maxWait_(std::chrono::microseconds(config.maxWaitUs)), stats_(stats) {
+        size_t workers = config.workers ? config.workers : num_threads();
+        for (size_t i = 0; i < workers; ++i)
+            workers_.emplace_back([this]() { work(); });
+    }
+
+    ~MicroBatcher() {
+        {
+            std::lock_guard<std::mutex> g(lock_);
+            stopping_ = true;
+        }
+        ready_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    std::future<double> submit(std::vector<double> row) {
+        auto req = std::make_unique<Request>();
+        req->row = std::move(row);
+        req->enqueued = Clock::now();
+        std::future<double> f = req->result.get_future();
+        {
+            std::lock_guard<std::mutex> g(lock_);
+            queue_.push_back(std::move(req));
+        }
+        ready_.notify_one();
+        return f;
+    }
+
+private:
+    void work() {
+        std::vector<std::unique_ptr<Request>> batch;
+        std::vector<std::vector<double>> rows;
+        while (true) {
+            batch.clear();
+            bool more = false;
+            {
+                std::unique_lock<std::mutex> g(lock_);
+                ready_.wait(g, [this]() { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) return;
+
+                // Hold the batch open until it is full or the oldest request
+                // has waited maxWait
+                Clock::time_point deadline = queue_.front()->enqueued + maxWait_;
+                while (queue_.size() < maxBatch_ && !stopping_ &&
+                       ready_.wait_until(g, deadline) != std::cv_status::timeout) {}
+
+                // Another worker may have taken everything while this one
+                // waited on the same deadline; go back to waiting.
+                size_t take = std::min(maxBatch_, queue_.size());
+                if (take == 0) continue;
+                for (size_t i = 0; i < take; ++i) {
+                    batch.push_back(std::move(queue_.front()));
+                    queue_.pop_front();
+                }
+                more = !queue_.empty();
+            }
+            if (more) ready_.notify_one();
+
+            rows.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i) rows[i].swap(batch[i]->row);
+
+            std::vector<double> preds;
+            {
+                PROFILE_SCOPE("serve.batch");
+                preds = model_.predict(rows);
+            }
+            stats_.recordBatch(batch.size());
+
+            Clock::time_point done = Clock::now();
+            for (size_t i = 0; i < batch.size(); ++i) {
+                batch[i]->result.set_value(preds[i]);
+                stats_.record(std::chrono::duration<double>(done - batch[i]->enqueued).count());
+            }
+        }
+    }
+
+    const ServedModel& model_;
+    size_t maxBatch_;
+    Clock::duration maxWait_;
+    LatencyStats& stats_;
+
+    std::vector<std::thread> workers_;
+    std::deque<std::unique_ptr<Request>> queue_;
+    std::mutex lock_;
+    std::condition_variable ready_;
+    bool stopping_ = false;
+};
+
+bool writeAll(int fd, const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        ssize_t n = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = write(fd, s.data() + off, s.size() - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+// Reads lines from inFd, answers them on outFd in arrival order. Every
+// complete line in a read is submitted before any answer is awaited, so
+// pipelined clients fill batches too.
+void serveStream(int inFd, int outFd, const ServedModel& model,
+                 MicroBatcher& batcher, const LatencyStats& stats) {
+    struct Pending {
+        std::future<double> result;
+        std::string immediate;   // answer known without scoring
+    };
+
+    std::string buffer;
+    char chunk[65536];
+    std::vector<double> row;
+    bool open = true;
+    while (open) {
+        ssize_t n = read(inFd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) {
+            if (g_stop) break;
+            continue;
+        }
+        if (n <= 0) open = false;
+        else buffer.append(chunk, n);
+
+        std::vector<Pending> pending;
+        size_t start = 0, nl;
+        while ((nl = buffer.find('\n', start)) != std::string::npos ||
+               (!open && start < buffer.size())) {
+            if (nl == std::string::npos) nl = buffer.size();
+            std::string line = buffer.substr(start, nl - start);
+            start = nl + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+
+            Pending p;
+            if (line == "STATS") p.immediate = stats.json();
+            else if (line.compare(0, 7, "INSERT ") == 0 || line.compare(0, 7, "DELETE ") == 0) {
+                // Rows sent earlier on this connection are scored first.
+                for (auto& q : pending)
+                    if (q.result.valid()) q.result.wait();
+                p.immediate = applyUpdate(line, model);
+            }
+            else if (!parseRow(line, row)) p.immediate = "ERR malformed row";
+            else if (!model.accepts(row.size()))
+                p.immediate = "ERR expected " + std::to_string(model.features) + " features";
+            else p.result = batcher.submit(row);
+            pending.push_back(std::move(p));
+        }
+        buffer.erase(0, std::min(start, buffer.size()));
+
+        std::string out;
+        for (auto& p : pending) {
+            out += p.immediate.empty() ? formatPrediction(model.kind, p.result.get()) : p.immediate;
+            out += '\n';
+        }
+        if (!out.empty() && !writeAll(outFd, out)) break;
+    }
+}
+
+int connectSocket(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+}  // namespace
+
+std::vector<double> ServedModel::predict(const std::vector<std::vector<double>>& rows) const {
+    switch (kind) {
+        case MODEL_LINEAR:
+            return predict_linear(linear, rows);
+        case MODEL_LOGISTIC: {
+            std::vector<int> p = predict_logistic(logistic, rows);
+            return std::vector<double>(p.begin(), p.end());
+        }
+        case MODEL_KNN: {
+            std::vector<int> p = knn->predict(rows);
+            return std::vector<double>(p.begin(), p.end());
+        }
+        case MODEL_TREE: {
+            std::vector<int> p = predict_flat_tree(tree, rows);
+            return std::vector<double>(p.begin(), p.end());
+        }
+        case MODEL_GNB: {
+            std::vector<int> p = predict_gnb(gnb, rows);
+            return std::vector<double>(p.begin(), p.end());
+        }
+        default:
+            return std::vector<double>(rows.size(), 0.0);
+    }
+}
+
+bool load_served_model(const std::string& path, ServedModel& model) {
+    auto mapped = std::make_shared<ModelFile>();
+    if (!mapped->open(path)) return false;
+    const ModelFile& file = *mapped;
+
+    model.kind = file.kind();
+    switch (model.kind) {
+        case MODEL_LINEAR:
+            if (!load_model(file, model.linear)) return false;
+            model.features = model.linear.weights.empty() ? 0 : model.linear.weights.size() - 1;
+            return true;
+        case MODEL_LOGISTIC:
+            if (!load_model(file, model.logistic)) return false;
+            model.features = model.logistic.weights.size();
+            return true;
+        case MODEL_KNN: {
+            KNNModel knn;
+            if (!load_model(file, knn)) return false;
+            model.knn = std::make_shared<KNNIndex>(knn);
+            model.features = model.knn->features();
+            return true;
+        }
+        case MODEL_TREE:
+            // Scored from the mapping, which the model keeps open.
+            if (!open_flat_tree(file, model.tree)) return false;
+            model.features = model.tree.features;
+            model.exactWidth = model.tree.exactWidth;
+            model.file = mapped;
+            return true;
+        case MODEL_GNB:
+            if (!load_model(file, model.gnb)) return false;
+            model.features = model.gnb.means.empty() ? 0 : model.gnb.means[0].size();
+            return !model.gnb.classes.empty();
+        default:
+            std::cerr << "Unknown model kind in " << path << "\n";
+            return false;
+    }
+}
+
+void printServerUsage(const char* prog) {
+    std::cout << "Usage: " << prog << " --serve MODEL [--socket PATH] [--max-batch N]\n"
+              << "                 [--max-wait-us N] [--workers N]\n"
+              << "       " << prog << " --loadgen --socket PATH --data FILE --target COL\n"
+              << "                 [--requests N] [--concurrency N]\n";
+}
+
+bool parseServerArgs(int argc, char** argv, ServerConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--serve" && hasValue) config.modelPath = argv[++i];
+        else if (arg == "--socket" && hasValue) config.socketPath = argv[++i];
+        else if (arg == "--max-batch" && hasValue) config.maxBatch = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--max-wait-us" && hasValue) config.maxWaitUs = std::atol(argv[++i]);
+        else if (arg == "--workers" && hasValue) config.workers = std::strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "Unknown or incomplete option: " << arg << "\n";
+            return false;
+        }
+    }
+    return !config.modelPath.empty();
+}
+
+bool parseLoadGenArgs(int argc, char** argv, LoadGenConfig& config) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--loadgen") continue;
+        else if (arg == "--socket" && hasValue) config.socketPath = argv[++i];
+        else if (arg == "--data" && hasValue) config.dataPath = argv[++i];
+        else if (arg == "--target" && hasValue) config.targetCol = std::atoi(argv[++i]);
+        else if (arg == "--requests" && hasValue) config.requests = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--concurrency" && hasValue) config.concurrency = std::strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "Unknown or incomplete option: " << arg << "\n";
+            return false;
+        }
+    }
+    return !config.socketPath.empty() && !config.dataPath.empty() && config.targetCol >= 0;
+}
+
+int runServer(const ServerConfig& config) {
+    ServedModel model;
+    {
+        double loadTime = 0.0;
+        ScopedTimer timer("serve.load", &loadTime);
+        if (!load_served_model(config.modelPath, model)) return 1;
+    }
+    std::cerr << "Serving " << modelKindName(model.kind) << " model (" << model.features
+              << " features), max batch " << config.maxBatch << ", max wait "
+              << config.maxWaitUs << " us\n";
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    LatencyStats stats;
+    {
+        MicroBatcher batcher(model, config, stats);
+
+        if (config.socketPath.empty()) {
+            serveStream(STDIN_FILENO, STDOUT_FILENO, model, batcher, stats);
+        }
+        else {
+            int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un addr;
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, config.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+            unlink(config.socketPath.c_str());
+            if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+                listen(listener, 128) != 0) {
+                std::cerr << "Failed to listen on " << config.socketPath << ": "
+                          << std::strerror(errno) << "\n";
+                if (listener >= 0) close(listener);
+                return 1;
+            }
+            std::cerr << "Listening on " << config.socketPath << " (" << kernels().name
+                      << " kernels, Ctrl-C to stop)\n";
+
+            struct Connection {
+                int fd;
+                std::thread thread;
+                std::shared_ptr<std::atomic<bool>> done;
+            };
+            std::vector<Connection> connections;
+            auto reap = [&connections](bool all) {
+                for (auto it = connections.begin(); it != connections.end();) {
+                    if (!all && !*it->done) { ++it; continue; }
+                    if (!*it->done) shutdown(it->fd, SHUT_RDWR);   // unblock the reader
+                    it->thread.join();
+                    close(it->fd);
+                    it = connections.erase(it);
+                }
+            };
+
+            while (!g_stop) {
+                pollfd pfd = {listener, POLLIN, 0};
+                int ready = poll(&pfd, 1, 200);
+                reap(false);
+                if (ready <= 0) continue;
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd < 0) continue;
+
+                auto done = std::make_shared<std::atomic<bool>>(false);
+                std::thread t([fd, done, &model, &batcher, &stats]() {
+                    serveStream(fd, fd, model, batcher, stats);
+                    *done = true;
+                });
+                connections.push_back({fd, std::move(t), done});
+            }
+            close(listener);
+            unlink(config.socketPath.c_str());
+            reap(true);
+        }
+    }
+
+    std::cerr << "Server stats: " << stats.json() << "\n";
+    profile_dump();
+    return 0;
+}
+
+int runLoadGenerator(const LoadGenConfig& config) {
+    {
+        std::ostringstream sink;
+        std::streambuf* saved = std::cout.rdbuf(sink.rdbuf());
+        loadData(config.dataPath, config.targetCol);
+        std::cout.rdbuf(saved);
+    }
+    if (!dataset.loaded) return 1;
+
+    std::vector<std::string> lines;
+    for (const auto& row : dataset.X) {
+        std::string line;
+        char buf[32];
+        for (size_t j = 0; j < row.size(); ++j) {
+            std::snprintf(buf, sizeof(buf), "%.17g", row[j]);
+            line += (j ? "," : "");
+            line += buf;
+        }
+        lines.push_back(line + "\n");
+    }
+
+    size_t clients = std::max<size_t>(1, config.concurrency);
+    std::atomic<size_t> next(0), errors(0);
+    std::vector<std::vector<double>> latencies(clients);
+    auto t0 = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            int fd = connectSocket(config.socketPath);
+            if (fd < 0) {
+                errors += 1;
+                return;
+            }
+            std::string reply;
+            char buf[4096];
+            for (size_t i = next++; i < config.requests; i = next++) {
+                auto start = Clock::now();
+                if (!writeAll(fd, lines[i % lines.size()])) { errors += 1; break; }
+                reply.clear();
+                while (reply.find('\n') == std::string::npos) {
+                    ssize_t n = read(fd, buf, sizeof(buf));
+                    if (n <= 0) break;
+                    reply.append(buf, n);
+                }
+                if (reply.empty() || reply.compare(0, 3, "ERR") == 0) errors += 1;
+                latencies[c].push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            close(fd);
+        });
+    }
+    for (auto& t : threads) t.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+
+    std::vector<double> all;
+    for (auto& v : latencies) all.insert(all.end(), v.begin(), v.end());
+    std::sort(all.begin(), all.end());
+    auto pct = [&](double q) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, size_t(q * (all.size() - 1) + 0.5))];
+    };
+
+    std::printf("Load generator: %zu requests over %zu connections in %.3f s\n",
+                all.size(), clients, elapsed);
+    std::printf("  client p50 %.3f ms  p99 %.3f ms  throughput %.1f req/s  errors %zu\n",
+                pct(0.50) * 1e3, pct(0.99) * 1e3, elapsed > 0 ? all.size() / elapsed : 0.0,
+                errors.load());
+
+    int fd = connectSocket(config.socketPath);
+    if (fd >= 0) {
+        std::string reply;
+        char buf[1024];
+        if (writeAll(fd, "STATS\n")) {
+            while (reply.find('\n') == std::string::npos) {
+                ssize_t n = read(fd, buf, sizeof(buf));
+                if (n <= 0) break;
+                reply.append(buf, n);
+            }
+        }
+        close(fd);
+        std::printf("  server %s", reply.c_str());
+    }
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ModelIO.h"
+
+// Any of the five model types loaded from a model file, scored in batches.
+struct ServedModel {
+    ModelKind kind = MODEL_NONE;
+    size_t features = 0;   // columns a request row must have
+    bool exactWidth = true;  // false only for tree files that predate the stored width
+    LinearModel linear;
+    LogisticModel logistic;
+    std::shared_ptr<KNNIndex> knn;   // updatable while serving
+    FlatTreeView tree;               // points into `file`
+    std::shared_ptr<const ModelFile> file;
+    GaussianNBModel gnb;
+
+    bool accepts(size_t columns) const {
+        return columns == features || (!exactWidth && columns > features);
+    }
+
+    std::vector<double> predict(const std::vector<std::vector<double>>& rows) const;
+};
+
+bool load_served_model(const std::string& path, ServedModel& model);
+
+// Serving mode: rows arrive one per line ("v1,v2,...") on a Unix domain
+// socket or stdin; concurrent requests are coalesced into micro-batches of
+// at most maxBatch rows, waiting at most maxWaitUs for a batch to fill.
+// Each line is answered in order with the prediction, "ERR <reason>", or
+// for the line "STATS" a JSON latency/throughput summary. k-NN reference
+// rows can change while serving: "INSERT label,v1,...,vn" answers
+// "OK <id>" and "DELETE <id>" answers "OK"; scoring keeps running against
+// the previous rows while an update is applied.
+struct ServerConfig {
+    std::string modelPath;
+    std::string socketPath;   // empty = stdin/stdout
+    size_t maxBatch = 64;
+    long maxWaitUs = 500;
+    size_t workers = 0;       // 0 = num_threads()
+};
+
+// Closed-loop client: each connection sends one row, waits for the answer,
+// then sends the next.
+struct LoadGenConfig {
+    std::string socketPath;
+    std::string dataPath;
+    int targetCol = -1;
+    size_t requests = 10000;
+    size_t concurrency = 8;
+};
+
+bool parseServerArgs(int argc, char** argv, ServerConfig& config);
+bool parseLoadGenArgs(int argc, char** argv, LoadGenConfig& config);
+void printServerUsage(const char* prog);
+
+int runServer(const ServerConfig& config);
+int runLoadGenerator(const LoadGenConfig& config);
+
+#endif
@@ -0,0 +1,77 @@
+#include "Sparse.h"
+#include <algorithm>
+
+void CsrMatrix::appendRow(std::vector<std::pair<uint32_t, double>>& entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    size_t start = values.size();
+    for (const auto& e : entries) {
+        if (values.size() > start && colIdx.back() == e.first) {
+            values.back() += e.second;
+            continue;
+        }
+        colIdx.push_back(e.first);
+        values.push_back(e.second);
+        cols = std::max<size_t>(cols, e.first + 1);
+    }
+    // Drop zeros, including sums that cancelled
+    size_t out = start;
+    for (size_t p = start; p < values.size(); ++p) {
+        if (values[p] == 0.0) continue;
+        colIdx[out] = colIdx[p];
+        values[out] = values[p];
+        ++out;
+    }
+    colIdx.resize(out);
+    values.resize(out);
+    rowPtr.push_back(out);
+}
+
+std::vector<double> csr_gemv(const CsrMatrix& X, const std::vector<double>& w, double bias) {
+    std::vector<double> out(X.rows());
+    for (size_t i = 0; i < X.rows(); ++i)
+        out[i] = sparse_dot(X, i, w) + bias;
+    return out;
+}
+
+std::vector<double> csr_gram(const CsrMatrix& X, const std::vector<double>& y,
+                             std::vector<double>& XTy) {
+    size_t d = X.cols + 1;
+    std::vector<double> G(d * d, 0.0);
+    XTy.assign(d, 0.0);
+    size_t icpt = X.cols;
+
+    for (size_t i = 0; i < X.rows(); ++i) {
+        size_t lo = X.rowPtr[i], hi = X.rowPtr[i + 1];
+        for (size_t p = lo; p < hi; ++p) {
+            size_t a = X.colIdx[p];
+            double xa = X.values[p];
+            // Upper triangle only; mirrored below
+            for (size_t q = p; q < hi; ++q)
+                G[a * d + X.colIdx[q]] += xa * X.values[q];
+            G[a * d + icpt] += xa;
+            XTy[a] += xa * y[i];
+        }
+        G[icpt * d + icpt] += 1.0;
+        XTy[icpt] += y[i];
+    }
+
+    for (size_t a = 0; a < d; ++a)
+        for (size_t b = 0; b < a; ++b)
+            G[a * d + b] = G[b * d + a];
+    return G;
+}
+
+CsrMatrix csr_select_rows(const CsrMatrix& X, const std::vector<size_t>& rows) {
+    CsrMatrix out;
+    out.cols = X.cols;
+    out.rowPtr.reserve(rows.size() + 1);
+    for (size_t r : rows) {
+        out.colIdx.insert(out.colIdx.end(), X.colIdx.begin() + X.rowPtr[r],
+                          X.colIdx.begin() + X.rowPtr[r + 1]);
+        out.values.insert(out.values.end(), X.values.begin() + X.rowPtr[r],
+                          X.values.begin() + X.rowPtr[r + 1]);
+        out.rowPtr.push_back(out.values.size());
+    }
+    return out;
+}
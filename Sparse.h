@@ -0,0 +1,46 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Compressed sparse row matrix. Row i holds the entries
+// [rowPtr[i], rowPtr[i + 1]) of colIdx/values, with ascending column indices
+// and no explicit zeros.
+struct CsrMatrix {
+    size_t cols = 0;
+    std::vector<size_t> rowPtr = {0};
+    std::vector<uint32_t> colIdx;
+    std::vector<double> values;
+
+    size_t rows() const { return rowPtr.size() - 1; }
+    size_t nnz() const { return values.size(); }
+
+    // Appends a row given as (column, value) pairs in any order; zeros are
+    // dropped and repeated columns are summed.
+    void appendRow(std::vector<std::pair<uint32_t, double>>& entries);
+};
+
+// Row `row` of X dotted with a dense vector: O(non-zeros in the row).
+inline double sparse_dot(const CsrMatrix& X, size_t row, const std::vector<double>& w) {
+    double sum = 0.0;
+    for (size_t p = X.rowPtr[row]; p < X.rowPtr[row + 1]; ++p)
+        sum += X.values[p] * w[X.colIdx[p]];
+    return sum;
+}
+
+// X * w + bias for every row.
+std::vector<double> csr_gemv(const CsrMatrix& X, const std::vector<double>& w, double bias = 0.0);
+
+// Normal equations with an intercept column appended (index cols): returns
+// the (cols + 1)^2 X^T X in row-major order and fills XTy. Each row costs
+// O(nnz^2) instead of O(cols^2).
+std::vector<double> csr_gram(const CsrMatrix& X, const std::vector<double>& y,
+                             std::vector<double>& XTy);
+
+// The listed rows, in order, as a new matrix.
+CsrMatrix csr_select_rows(const CsrMatrix& X, const std::vector<size_t>& rows);
+
+#endif
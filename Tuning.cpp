@@ -0,0 +1,311 @@
+#include "Tuning.h"
+#include "LinearRegression.h"
+#include "LogisticRegression.h"
+#include "KNN.h"
+#include "DecisionTree.h"
+#include "GaussianNB.h"
+#include "Metrics.h"
+#include "Parallel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <map>
+#include <sstream>
+
+namespace {
+
+// Fold-invariant inputs, computed once before any fold is searched.
+struct SharedWork {
+    std::vector<double> y_d;
+    TreeBins bins;
+    std::vector<Scaler> scalers;   // per fold, from its training rows
+
+    const Scaler* scalerOrNull(size_t fold) const {
+        return fold < scalers.size() && scalers[fold].active() ? &scalers[fold] : nullptr;
+    }
+};
+
+std::vector<Hyperparams> gridFor(const std::string& algo, const SearchSpace& s,
+                                 const Hyperparams& base) {
+    std::vector<Hyperparams> grid;
+    Hyperparams p = base;
+    if (algo == "linear") {
+        for (double lambda : s.lambda) { p.lambda = lambda; grid.push_back(p); }
+    }
+    else if (algo == "logistic") {
+        for (double lr : s.lr)
+            for (int epochs : s.epochs)
+                for (double reg : s.reg) {
+                    p.lr = lr;
+                    p.epochs = epochs;
+                    p.reg = reg;
+                    grid.push_back(p);
+                }
+    }
+    else if (algo == "knn") {
+        for (int k : s.k) { p.k = k; grid.push_back(p); }
+    }
+    else if (algo == "tree") {
+        for (int depth : s.maxDepth) { p.maxDepth = depth; grid.push_back(p); }
+    }
+    else {
+        grid.push_back(p);   // gnb has nothing to tune
+    }
+    return grid;
+}
+
+std::string describe(const std::string& algo, const Hyperparams& p) {
+    std::ostringstream out;
+    if (algo == "linear") out << "--lambda " << p.lambda;
+    else if (algo == "logistic") out << "--lr " << p.lr << " --epochs " << p.epochs << " --reg " << p.reg;
+    else if (algo == "knn") out << "--k " << p.k;
+    else if (algo == "tree") out << "--max-depth " << p.maxDepth;
+    else out << "-";
+    return out.str();
+}
+
+void scoreClassifier(FoldScore& s, const std::vector<int>& y_true, const std::vector<int>& y_pred) {
+    ConfusionMatrix cm = confusion_matrix(y_true, y_pred);
+    s.accuracy = cm.accuracy();
+    s.macroF1 = cm.macroF1();
+}
+
+// Logistic candidates sharing one lr: a cold run along the epoch axis at the
+// largest reg, then warm-started runs down the reg path for each epoch count.
+void searchLogistic(const std::vector<Hyperparams>& cands, const std::vector<size_t>& idx,
+                    const std::vector<std::vector<double>>& X, const std::vector<int>& y,
+                    const FoldIndices& fold, const std::vector<int>& y_true,
+                    double warmFraction, const Scaler* scaler, std::vector<FoldScore>& scores) {
+    double lr = cands[idx[0]].lr;
+    std::vector<int> epochs;
+    std::vector<double> regs;
+    for (size_t i : idx) {
+        epochs.push_back(cands[i].epochs);
+        regs.push_back(cands[i].reg);
+    }
+    std::sort(epochs.begin(), epochs.end());
+    epochs.erase(std::unique(epochs.begin(), epochs.end()), epochs.end());
+    std::sort(regs.begin(), regs.end(), std::greater<double>());
+    regs.erase(std::unique(regs.begin(), regs.end()), regs.end());
+
+    std::map<std::pair<int, double>, LogisticModel> models;
+    LogisticModel cold;
+    int done = 0;
+    for (int e : epochs) {
+        cold = done == 0 ? fit_logistic(X, y, fold.train, lr, e, regs[0], scaler)
+                         : fit_logistic(X, y, fold.train, lr, e - done, regs[0], cold, scaler);
+        done = e;
+        models[{e, regs[0]}] = cold;
+    }
+
+    for (int e : epochs) {
+        size_t deepest = 0;
+        for (size_t i : idx)
+            if (cands[i].epochs == e)
+                deepest = std::max<size_t>(deepest, std::find(regs.begin(), regs.end(), cands[i].reg) - regs.begin());
+
+        int warm = std::max(1, int(std::ceil(e * warmFraction)));
+        LogisticModel m = models[{e, regs[0]}];
+        for (size_t j = 1; j <= deepest; ++j) {
+            m = fit_logistic(X, y, fold.train, lr, warm, regs[j], m, scaler);
+            models[{e, regs[j]}] = m;
+        }
+    }
+
+    for (size_t i : idx)
+        scoreClassifier(scores[i], y_true,
+                        predict_logistic(models[{cands[i].epochs, cands[i].reg}], X, fold.test));
+}
+
+// Scores every candidate of one algorithm on one fold.
+std::vector<FoldScore> searchFold(const std::string& algo, const std::vector<Hyperparams>& cands,
+                                  const std::vector<std::vector<double>>& X,
+                                  const std::vector<int>& y, const SharedWork& shared,
+                                  size_t f, const FoldIndices& fold, double warmFraction,
+                                  double& time) {
+    ScopedTimer timer("tune.fold", &time);
+    std::vector<FoldScore> scores(cands.size());
+    std::vector<int> y_true;
+    for (size_t r : fold.test) y_true.push_back(y[r]);
+
+    if (algo == "linear") {
+        LinearGram gram = linear_gram(X, shared.y_d, fold.train, shared.scalerOrNull(f));
+        std::vector<double> y_true_d(y_true.begin(), y_true.end());
+        for (size_t i = 0; i < cands.size(); ++i) {
+            try {
+                LinearModel model = fit_linear(gram, cands[i].lambda);
+                scores[i].rmse = computeRMSE(y_true_d, predict_linear(model, X, fold.test));
+            }
+            catch (const std::exception&) {
+                scores[i].rmse = std::nan("");   // e.g. singular without ridge
+            }
+        }
+    }
+    else if (algo == "logistic") {
+        std::map<double, std::vector<size_t>> byLr;
+        for (size_t i = 0; i < cands.size(); ++i) byLr[cands[i].lr].push_back(i);
+        for (auto& group : byLr)
+            searchLogistic(cands, group.second, X, y, fold, y_true, warmFraction,
+                           shared.scalerOrNull(f), scores);
+    }
+    else if (algo == "knn") {
+        int kmax = 0;
+        for (const Hyperparams& p : cands) kmax = std::max(kmax, p.k);
+        NeighborLists lists = knn_neighbors(X, y, fold.train, fold.test, kmax,
+                                            shared.scalerOrNull(f));
+        for (size_t i = 0; i < cands.size(); ++i)
+            scoreClassifier(scores[i], y_true, vote_neighbors(lists, cands[i].k));
+    }
+    else if (algo == "tree") {
+        int deepest = 0;
+        for (const Hyperparams& p : cands) deepest = std::max(deepest, p.maxDepth);
+        DecisionTreeModel model = fit_tree(X, y, fold.train, deepest, &shared.bins);
+        for (size_t i = 0; i < cands.size(); ++i)
+            scoreClassifier(scores[i], y_true, predict_tree(model, X, fold.test, cands[i].maxDepth));
+    }
+    else if (algo == "gnb") {
+        GaussianNBModel model = fit_gnb(X, y, fold.train);
+        scoreClassifier(scores[0], y_true, predict_gnb(model, X, fold.test));
+    }
+    return scores;
+}
+
+MeanStd summarize(const std::vector<double>& values) {
+    MeanStd m;
+    if (values.empty()) return m;
+    for (double v : values) m.mean += v;
+    m.mean /= values.size();
+    if (values.size() > 1) {
+        double ss = 0.0;
+        for (double v : values) ss += (v - m.mean) * (v - m.mean);
+        m.stddev = std::sqrt(ss / (values.size() - 1));
+    }
+    return m;
+}
+
+bool uses(const std::vector<std::string>& algorithms, const char* name) {
+    return std::find(algorithms.begin(), algorithms.end(), name) != algorithms.end();
+}
+
+} // namespace
+
+std::vector<SearchResult> search_hyperparams(const std::vector<std::vector<double>>& X,
+                                             const std::vector<int>& y,
+                                             const std::vector<std::string>& algorithms,
+                                             const SearchConfig& config) {
+    PROFILE_SCOPE("tune");
+    std::vector<FoldIndices> folds = config.stratified
+        ? stratified_kfold_indices(y, config.folds, config.seed)
+        : kfold_indices(X.size(), config.folds, config.seed);
+
+    std::vector<SearchResult> results(algorithms.size());
+    std::vector<std::vector<Hyperparams>> cands(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        results[a].algorithm = algorithms[a];
+        results[a].regression = algorithms[a] == "linear";
+        cands[a] = gridFor(algorithms[a], config.space, config.base);
+        if (config.random && cands[a].size() > config.trials) {
+            RngStream rng(config.seed, a);
+            deterministic_shuffle(cands[a], rng);
+            cands[a].resize(config.trials);
+        }
+        if (folds.empty()) results[a].error = "need 2 <= folds <= rows";
+        else if (cands[a].empty()) results[a].error = "empty search space";
+    }
+    if (folds.empty()) return results;
+
+    SharedWork shared;
+    {
+        PROFILE_SCOPE("tune.shared");
+        if (config.base.scale != SCALE_NONE) {
+            shared.scalers.resize(folds.size());
+            parallel_for(0, folds.size(), 1, [&](size_t lo, size_t hi) {
+                for (size_t f = lo; f < hi; ++f)
+                    shared.scalers[f] = make_scaler(X, folds[f].train, config.base.scale);
+            });
+        }
+        if (uses(algorithms, "linear")) shared.y_d.assign(y.begin(), y.end());
+        if (uses(algorithms, "tree")) shared.bins = bin_features(X);
+    }
+
+    ThreadPool& pool = shared_pool();
+    std::vector<std::vector<double>> times(algorithms.size(), std::vector<double>(folds.size(), 0.0));
+    std::vector<std::vector<std::future<std::vector<FoldScore>>>> pending(algorithms.size());
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        if (cands[a].empty()) continue;
+        for (size_t f = 0; f < folds.size(); ++f) {
+            const std::string& algo = algorithms[a];
+            const std::vector<Hyperparams>& c = cands[a];
+            const FoldIndices& fold = folds[f];
+            double& time = times[a][f];
+            double warm = config.warmFraction;
+            pending[a].push_back(pool.submit([&X, &y, &shared, &algo, &c, &fold, &time, warm, f]() {
+                return searchFold(algo, c, X, y, shared, f, fold, warm, time);
+            }));
+        }
+    }
+
+    for (size_t a = 0; a < algorithms.size(); ++a) {
+        SearchResult& r = results[a];
+        std::vector<std::vector<FoldScore>> perFold;
+        for (auto& f : pending[a]) {
+            try {
+                perFold.push_back(f.get());
+            }
+            catch (const std::exception& e) {
+                if (r.error.empty()) r.error = e.what();
+            }
+        }
+        for (double t : times[a]) r.time += t;
+        if (!r.error.empty()) continue;
+
+        for (size_t i = 0; i < cands[a].size(); ++i) {
+            std::vector<double> acc, f1, rmse;
+            for (const auto& scores : perFold) {
+                acc.push_back(scores[i].accuracy);
+                f1.push_back(scores[i].macroF1);
+                rmse.push_back(scores[i].rmse);
+            }
+            Candidate c{cands[a][i], summarize(acc), summarize(f1), summarize(rmse)};
+            if (std::isnan(c.rmse.mean)) r.failed++;
+            else r.candidates.push_back(c);
+        }
+        std::stable_sort(r.candidates.begin(), r.candidates.end(),
+                         [&](const Candidate& x, const Candidate& z) {
+                             return r.regression ? x.rmse.mean < z.rmse.mean
+                                                 : x.macroF1.mean > z.macroF1.mean;
+                         });
+    }
+    return results;
+}
+
+void printSearchResults(const std::vector<SearchResult>& results, double wallTime) {
+    const size_t shown = 5;
+    std::string best;
+    for (const SearchResult& r : results) {
+        if (!r.error.empty()) {
+            std::printf("\n%s failed: %s\n", r.algorithm.c_str(), r.error.c_str());
+            continue;
+        }
+        std::printf("\n%s: %zu candidates, %.6f s\n", r.algorithm.c_str(),
+                    r.candidates.size() + r.failed, r.time);
+        if (r.failed) std::printf("  (%zu failed to fit)\n", r.failed);
+        for (size_t i = 0; i < r.candidates.size() && i < shown; ++i) {
+            const Candidate& c = r.candidates[i];
+            std::string params = describe(r.algorithm, c.params);
+            if (r.regression)
+                std::printf("  %-36s RMSE %10.6f +- %8.6f\n", params.c_str(),
+                            c.rmse.mean, c.rmse.stddev);
+            else
+                std::printf("  %-36s macro-F1 %8.6f +- %8.6f  accuracy %8.4f%%\n", params.c_str(),
+                            c.macroF1.mean, c.macroF1.stddev, c.accuracy.mean * 100.0);
+        }
+        if (!r.candidates.empty() && r.algorithm != "gnb")
+            best += " " + describe(r.algorithm, r.candidates[0].params);
+    }
+    std::printf("\nWall time: %.6f s\n", wallTime);
+    if (!best.empty()) std::printf("Best settings:%s\n", best.c_str());
+}
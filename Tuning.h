@@ -0,0 +1,68 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CrossValidation.h"
+#include "Hyperparams.h"
+
+// Values tried per parameter. Every combination for an algorithm's own
+// parameters is a grid point; random search samples from those points.
+struct SearchSpace {
+    std::vector<double> lambda = {100.0, 10.0, 1.0, 0.1, 0.01, 0.0};
+    std::vector<double> lr = {0.001, 0.01};
+    std::vector<int> epochs = {10, 25, 50, 100};
+    std::vector<double> reg = {0.1, 0.01, 0.001, 0.0};
+    std::vector<int> k = {1, 3, 5, 7, 9, 15, 21};
+    std::vector<int> maxDepth = {2, 4, 6, 8, 10, 12, 16};
+};
+
+// Candidates are scored by cross-validation. Within one fold the expensive
+// work is shared by all candidates of an algorithm:
+//   linear    one X^T X per fold, solved for each lambda
+//   knn       neighbor lists for the largest k, sliced for smaller k
+//   tree      one tree grown to the largest depth, scored truncated
+//   logistic  per lr, one SGD run snapshotted at each epoch count; each
+//             smaller reg is warm-started from the next larger one and
+//             trained for warmFraction of its epochs
+// The logistic warm starts approximate a cold fit; everything else is exact.
+struct SearchConfig {
+    SearchSpace space;
+    bool random = false;
+    size_t trials = 20;        // random search: grid points sampled per algorithm
+    int folds = 3;
+    bool stratified = false;
+    uint64_t seed = 42;
+    double warmFraction = 0.25;
+    Hyperparams base;   // settings not being searched; base.scale is fitted per fold
+};
+
+struct Candidate {
+    Hyperparams params;
+    MeanStd accuracy;
+    MeanStd macroF1;
+    MeanStd rmse;
+};
+
+// Candidates ranked best first: highest mean macro-F1, or lowest mean RMSE
+// for linear regression.
+struct SearchResult {
+    std::string algorithm;
+    bool regression = false;
+    std::vector<Candidate> candidates;
+    size_t failed = 0;         // candidates that could not be fitted
+    double time = 0.0;         // summed over fold tasks
+    std::string error;
+};
+
+std::vector<SearchResult> search_hyperparams(const std::vector<std::vector<double>>& X,
+                                             const std::vector<int>& y,
+                                             const std::vector<std::string>& algorithms,
+                                             const SearchConfig& config);
+
+void printSearchResults(const std::vector<SearchResult>& results, double wallTime);
+
+#endif
@@ -1,95 +1,469 @@
 #include "loadData.h"
+#include "Profiler.h"
+#include "Parallel.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <iterator>
-#include <random>
+#include <limits>
+#include <numeric>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
 
 Dataset dataset;
 
+static bool readHeaders(std::ifstream& file, std::vector<std::string>& headers) {
+    std::string line;
+    if (!std::getline(file, line)) return false;
+
+    std::stringstream ss(line);
+    std::string token;
+    while (std::getline(ss, token, ',')) {
+        token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+        headers.push_back(token);
+    }
+    return true;
+}
+
+// Feature row and label of one CSV line, parsed exactly as loadData does.
+// Blank lines (a trailing newline, a stray "\r") hold no row.
+static bool blankLine(const std::string& line) {
+    return line.find_first_not_of(" \r") == std::string::npos;
+}
+
+static void parseLine(const std::string& line, int targetCol,
+                      std::vector<double>& row, int& label) {
+    std::stringstream ss(line);
+    std::string token;
+    row.clear();
+    label = 0;
+    int colIndex = 0;
+    while (std::getline(ss, token, ',')) {
+        token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+        if (colIndex == targetCol) {
+            label = token == ">50K" ? 1 : 0;
+        } else {
+            try {
+                row.push_back(std::stod(token));
+            }
+            catch (...) {
+                row.push_back(0.0);
+            }
+        }
+        colIndex++;
+    }
+}
+
+// Label of a CSV line, found by counting commas; no feature is converted.
+static int parseLabel(const std::string& line, int targetCol) {
+    size_t start = 0;
+    for (int c = 0; c < targetCol; ++c) {
+        start = line.find(',', start);
+        if (start == std::string::npos) return 0;
+        ++start;
+    }
+    size_t end = line.find(',', start);
+    std::string token = line.substr(start, end == std::string::npos ? end : end - start);
+    token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+    return token == ">50K" ? 1 : 0;
+}
+
 void loadData(const std::string& filename) {
     std::ifstream file(filename);
     if (!file.is_open()) {
         std::cerr << "Failed to open file: " << filename << "\n";
         return;
     }
+
+    std::vector<std::string> headers;
+    readHeaders(file, headers);
+    file.close();
+    
+    std::cout << "Columns found:\n";
+    for (size_t i = 0; i < headers.size(); i++)
+        std::cout << i << ": " << headers[i] << "\n";
+    
+    int targetCol;
+    std::cout << "Enter the column number to use as target: ";
+    std::cin >> targetCol;
+
+    loadData(filename, targetCol);
+}
+
+static void loadAll(const std::string& filename, int targetCol, bool stats) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return;
+    }
     
     dataset.X.clear();
     dataset.y.clear();
     dataset.headers.clear();
+    dataset.stats.clear();
+    dataset.loaded = false;
+    readHeaders(file, dataset.headers);
     
+    PROFILE_SCOPE("load.parse");
     std::string line;
-    if (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string token;
-        while (std::getline(ss, token, ',')) {
-            token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
-            dataset.headers.push_back(token);
-        }
+    while (std::getline(file, line)) {
+        if (blankLine(line)) continue;
+        std::vector<double> row;
+        int label;
+        parseLine(line, targetCol, row, label);
+        dataset.y.push_back(label);
+        if (stats) dataset.stats.add(row);
+        dataset.X.push_back(std::move(row));
     }
     
-    std::cout << "Columns found:\n";
-    for (size_t i = 0; i < dataset.headers.size(); i++)
-        std::cout << i << ": " << dataset.headers[i] << "\n";
-    
-    int targetCol;
-    std::cout << "Enter the column number to use as target: ";
-    std::cin >> targetCol;
-    
+    if (dataset.X.empty()) {
+        std::cerr << "No samples found in: " << filename << "\n";
+        return;
+    }
+
+    PROFILE_COUNT("load.rows", dataset.X.size());
+    dataset.loaded = true;
+    std::cout << "Loaded " << dataset.X.size() << " samples with " 
+              << dataset.X[0].size() << " features.\n";
+}
+
+void loadData(const std::string& filename, int targetCol) {
+    loadAll(filename, targetCol, false);
+}
+
+namespace {
+
+// Uniform sample of up to `capacity` rows from a stream (Li's Algorithm L).
+// Once full, the number of rows to pass over before the next replacement
+// is drawn directly, so a rejected row costs a counter decrement and the
+// random draws grow with log(rows), not rows.
+struct Reservoir {
+    size_t capacity;
+    RngStream rng;
+    std::vector<std::vector<double>> rows;
+    std::vector<int> labels;
+    std::vector<size_t> lines;   // position of each kept row in the file
+    double w = 1.0;
+    uint64_t skip = 0;
+
+    Reservoir(size_t capacity, uint64_t seed, uint64_t stream)
+        : capacity(capacity), rng(seed, stream) {}
+
+    // True when the next row is rejected; consumes it from the skip count.
+    bool passOver() {
+        if (rows.size() < capacity || skip == 0) return false;
+        --skip;
+        return true;
+    }
+
+    // Slot the next (accepted) row is parsed into.
+    size_t accept() {
+        size_t slot;
+        if (rows.size() < capacity) {
+            slot = rows.size();
+            rows.emplace_back();
+            labels.push_back(0);
+            lines.push_back(0);
+            if (rows.size() < capacity) return slot;
+        } else {
+            slot = rng.below(capacity);
+        }
+        w *= std::exp(std::log(open_uniform()) / double(capacity));
+        double gap = std::floor(std::log(open_uniform()) / std::log1p(-w));
+        skip = gap < 1.8e19 ? uint64_t(gap) : UINT64_MAX;
+        return slot;
+    }
+
+    double open_uniform() { return 1.0 - rng.uniform(); }   // (0, 1]
+
+    // Keeps a uniform subset of `keep` rows.
+    void shrink(size_t keep) {
+        if (keep >= rows.size()) return;
+        std::vector<size_t> pick(rows.size());
+        std::iota(pick.begin(), pick.end(), size_t(0));
+        deterministic_shuffle(pick, rng);
+        pick.resize(keep);
+        std::sort(pick.begin(), pick.end());
+        for (size_t i = 0; i < keep; ++i) {
+            if (pick[i] == i) continue;
+            rows[i] = std::move(rows[pick[i]]);
+            labels[i] = labels[pick[i]];
+            lines[i] = lines[pick[i]];
+        }
+        rows.resize(keep);
+        labels.resize(keep);
+        lines.resize(keep);
+    }
+};
+
+} // namespace
+
+void loadData(const std::string& filename, int targetCol, const LoadSampling& sampling) {
+    if (sampling.rows == 0) {
+        loadAll(filename, targetCol, sampling.stats);
+        return;
+    }
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return;
+    }
+
+    dataset.X.clear();
+    dataset.y.clear();
+    dataset.headers.clear();
+    dataset.stats.clear();
+    dataset.loaded = false;
+    readHeaders(file, dataset.headers);
+
+    PROFILE_SCOPE("load.sample");
+    std::vector<Reservoir> pools;      // one per class when stratified
+    std::vector<int> classes;          // label of each pool
+    std::vector<size_t> seen;          // rows offered to each pool
+    std::string line;
+    size_t lineNo = 0;
+
+    if (!sampling.stratified) {
+        pools.emplace_back(sampling.rows, sampling.seed, 0);
+        seen.push_back(0);
+        Reservoir& pool = pools[0];
+        while (true) {
+            if (pool.passOver()) {
+                file.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+                if (file.gcount() == 0) break;
+            } else {
+                if (!std::getline(file, line)) break;
+                if (blankLine(line)) continue;
+                size_t slot = pool.accept();
+                parseLine(line, targetCol, pool.rows[slot], pool.labels[slot]);
+                pool.lines[slot] = lineNo;
+            }
+            ++lineNo;
+        }
+        seen[0] = lineNo;
+    } else {
+        // Class shares are only known at the end, so every class keeps a
+        // full-size reservoir and is cut to its share afterwards; a uniform
+        // subset of a uniform sample is still uniform.
+        while (std::getline(file, line)) {
+            if (blankLine(line)) continue;
+            int label = parseLabel(line, targetCol);
+            size_t c = std::find(classes.begin(), classes.end(), label) - classes.begin();
+            if (c == classes.size()) {
+                classes.push_back(label);
+                pools.emplace_back(sampling.rows, sampling.seed, c);
+                seen.push_back(0);
+            }
+            ++seen[c];
+            Reservoir& pool = pools[c];
+            if (!pool.passOver()) {
+                size_t slot = pool.accept();
+                parseLine(line, targetCol, pool.rows[slot], pool.labels[slot]);
+                pool.lines[slot] = lineNo;
+            }
+            ++lineNo;
+        }
+
+        // Largest-remainder quotas; ties go to the class seen first.
+        std::vector<size_t> quota(pools.size());
+        std::vector<std::pair<double, size_t>> remainders;
+        size_t given = 0;
+        for (size_t c = 0; c < pools.size(); ++c) {
+            double exact = double(sampling.rows) * seen[c] / double(lineNo);
+            quota[c] = std::min(size_t(exact), pools[c].rows.size());
+            given += quota[c];
+            remainders.emplace_back(-(exact - std::floor(exact)), c);
+        }
+        std::sort(remainders.begin(), remainders.end());
+        for (auto& r : remainders) {
+            if (given >= std::min(sampling.rows, lineNo)) break;
+            size_t c = r.second;
+            if (quota[c] < pools[c].rows.size()) {
+                ++quota[c];
+                ++given;
+            }
+        }
+        for (size_t c = 0; c < pools.size(); ++c) pools[c].shrink(quota[c]);
+    }
+
+    // Kept rows go out in file order.
+    std::vector<std::pair<size_t, std::pair<size_t, size_t>>> order;
+    for (size_t c = 0; c < pools.size(); ++c)
+        for (size_t i = 0; i < pools[c].rows.size(); ++i)
+            order.push_back({pools[c].lines[i], {c, i}});
+    std::sort(order.begin(), order.end());
+    dataset.X.reserve(order.size());
+    dataset.y.reserve(order.size());
+    for (auto& o : order) {
+        Reservoir& pool = pools[o.second.first];
+        if (sampling.stats) dataset.stats.add(pool.rows[o.second.second]);
+        dataset.X.push_back(std::move(pool.rows[o.second.second]));
+        dataset.y.push_back(pool.labels[o.second.second]);
+    }
+
+    if (dataset.X.empty()) {
+        std::cerr << "No samples found in: " << filename << "\n";
+        return;
+    }
+
+    PROFILE_COUNT("load.rows", lineNo);
+    PROFILE_COUNT("load.sampled_rows", dataset.X.size());
+    dataset.loaded = true;
+    std::cout << "Sampled " << dataset.X.size() << " of " << lineNo << " samples"
+              << (sampling.stratified ? " (stratified by class)" : "") << " with "
+              << dataset.X[0].size() << " features.\n";
+}
+
+bool loadSparse(const std::string& filename, int targetCol, SparseDataset& out) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << "\n";
+        return false;
+    }
+
+    out = SparseDataset();
+    std::vector<std::string> headers;
+    readHeaders(file, headers);
+
+    PROFILE_SCOPE("load.sparse");
+    std::unordered_map<std::string, uint32_t> featureIds;
+    auto featureId = [&](const std::string& name) {
+        auto it = featureIds.find(name);
+        if (it != featureIds.end()) return it->second;
+        uint32_t id = uint32_t(out.features.size());
+        featureIds.emplace(name, id);
+        out.features.push_back(name);
+        return id;
+    };
+
+    std::string line;
+    std::vector<std::pair<uint32_t, double>> entries;
     while (std::getline(file, line)) {
+        if (blankLine(line)) continue;
         std::stringstream ss(line);
         std::string token;
-        std::vector<double> row;
         int colIndex = 0;
-        
+        int label = 0;   // as parseLine: a short line gets the default label
+        entries.clear();
+
         while (std::getline(ss, token, ',')) {
             token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+            std::string column = colIndex < (int)headers.size() ? headers[colIndex]
+                                                                : std::to_string(colIndex);
             if (colIndex == targetCol) {
-                dataset.y.push_back(token == ">50K" ? 1 : 0);
-            } else {
-                try { 
-                    row.push_back(std::stod(token)); 
-                }
-                catch (...) { 
-                    row.push_back(0.0); 
+                label = token == ">50K" ? 1 : 0;
+            } else if (!token.empty()) {
+                // Whole-token numeric parse: "7th-8th" is a category, not 7
+                char* end = nullptr;
+                double v = std::strtod(token.c_str(), &end);
+                if (*end == '\0') {
+                    if (v != 0.0) entries.emplace_back(featureId(column), v);
+                } else {
+                    entries.emplace_back(featureId(column + "=" + token), 1.0);
                 }
             }
             colIndex++;
         }
-        dataset.X.push_back(row);
+        out.X.appendRow(entries);
+        out.y.push_back(label);
     }
-    
-    dataset.loaded = true;
-    std::cout << "Loaded " << dataset.X.size() << " samples with " 
-              << dataset.X[0].size() << " features.\n";
+    out.X.cols = out.features.size();
+
+    if (out.X.rows() == 0) {
+        std::cerr << "No samples found in: " << filename << "\n";
+        return false;
+    }
+    if (out.X.rows() != out.y.size()) {
+        std::cerr << "Row and label counts differ in: " << filename << "\n";
+        return false;
+    }
+
+    PROFILE_COUNT("load.rows", out.X.rows());
+    out.loaded = true;
+    std::cout << "Loaded " << out.X.rows() << " samples with " << out.X.cols
+              << " sparse features (" << out.X.nnz() << " non-zeros).\n";
+    return true;
 }
 
-void splitDataset(double trainFraction) {
+void splitDataset(double trainFraction, uint64_t seed) {
     if (!dataset.loaded) return;
+    PROFILE_SCOPE("split");
     
     size_t n = dataset.X.size();
     std::vector<size_t> indices(n);
     std::iota(indices.begin(), indices.end(), 0);
     
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(indices.begin(), indices.end(), g);
+    RngStream rng(seed);
+    deterministic_shuffle(indices, rng);
     
-    size_t trainSize = static_cast<size_t>(n * trainFraction);
+    size_t trainSize = std::min(n, static_cast<size_t>(n * trainFraction));
     
-    dataset.X_train.clear();
-    dataset.y_train.clear();
-    dataset.X_test.clear();
-    dataset.y_test.clear();
+    dataset.X_train.assign(trainSize, {});
+    dataset.y_train.assign(trainSize, 0);
+    dataset.X_test.assign(n - trainSize, {});
+    dataset.y_test.assign(n - trainSize, 0);
     
-    for (size_t i = 0; i < n; ++i) {
-        if (i < trainSize) {
-            dataset.X_train.push_back(dataset.X[indices[i]]);
-            dataset.y_train.push_back(dataset.y[indices[i]]);
+    // Every row has a fixed destination, so the copies run in parallel.
+    parallel_for(0, n, 1024, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            size_t src = indices[i];
+            if (i < trainSize) {
+                dataset.X_train[i] = dataset.X[src];
+                dataset.y_train[i] = dataset.y[src];
+            } else {
+                dataset.X_test[i - trainSize] = dataset.X[src];
+                dataset.y_test[i - trainSize] = dataset.y[src];
+            }
+        }
+    });
+}
+
+namespace {
+
+// Hashes and compares rows by index, so the table holds no copies. Values
+// are compared with ==, as the models see them (0.0 and -0.0 are one row).
+struct RowKey {
+    const std::vector<std::vector<double>>* X;
+    const std::vector<int>* y;
+
+    size_t operator()(size_t i) const {
+        uint64_t h = 0x9e3779b97f4a7c15ull ^ uint64_t(int64_t((*y)[i]));
+        for (double v : (*X)[i]) {
+            if (v == 0) v = 0;   // fold -0.0 into 0.0
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            h = (h ^ bits) * 0x100000001b3ull;
+            h ^= h >> 29;
+        }
+        return size_t(h);
+    }
+
+    bool operator()(size_t a, size_t b) const {
+        return (*y)[a] == (*y)[b] && (*X)[a] == (*X)[b];
+    }
+};
+
+} // namespace
+
+WeightedSet dedupRows(const std::vector<std::vector<double>>& X, const std::vector<int>& y) {
+    PROFILE_SCOPE("dedup");
+    RowKey key{&X, &y};
+    std::unordered_map<size_t, size_t, RowKey, RowKey> slot(X.size(), key, key);
+
+    WeightedSet out;
+    for (size_t i = 0; i < X.size(); ++i) {
+        auto it = slot.emplace(i, out.X.size());
+        if (it.second) {
+            out.X.push_back(X[i]);
+            out.y.push_back(y[i]);
+            out.weights.push_back(1.0);
         } else {
-            dataset.X_test.push_back(dataset.X[indices[i]]);
-            dataset.y_test.push_back(dataset.y[indices[i]]);
+            out.weights[it.first->second] += 1.0;
         }
     }
+    PROFILE_COUNT("dedup.distinct", out.X.size());
+    return out;
 }
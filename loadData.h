@@ -1,14 +1,19 @@
 #ifndef LOADDATA_H
 #define LOADDATA_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "Scaler.h"
+#include "Sparse.h"
+
 // Dataset struct
 struct Dataset {
     std::vector<std::vector<double>> X;
     std::vector<int> y;
     std::vector<std::string> headers;
+    FeatureStats stats;   // column statistics of X, gathered while parsing on request
     bool loaded = false;
 
     std::vector<std::vector<double>> X_train;
@@ -19,8 +24,44 @@ struct Dataset {
 
 extern Dataset dataset;
 
+// One-hot view of a CSV: every numeric column is one feature, every other
+// (column, token) pair its own 0/1 feature named "column=token".
+struct SparseDataset {
+    CsrMatrix X;
+    std::vector<int> y;
+    std::vector<std::string> features;   // name of each column of X
+    bool loaded = false;
+};
+
+// Distinct rows of a labeled matrix, in order of first appearance, each
+// with the number of times it occurred. The weighted tree, linear and
+// naive Bayes fits on these match fits on every copy (up to summation
+// order) at the cost of the distinct rows only; weighted logistic SGD
+// takes fewer, larger steps instead.
+struct WeightedSet {
+    std::vector<std::vector<double>> X;
+    std::vector<int> y;
+    std::vector<double> weights;   // integer counts
+};
+
+// Row sampling done while parsing: rejected rows are skipped without
+// converting their features and only the sample is held. Plain sampling is
+// a uniform reservoir; stratified keeps each class's share of the file
+// (one reservoir per class, so up to rows x classes are held while reading).
+// The sample keeps file order and depends only on the file and the seed.
+struct LoadSampling {
+    size_t rows = 0;          // sample size; 0 = load every row
+    bool stratified = false;
+    uint64_t seed = 42;
+    bool stats = false;       // also fill dataset.stats; only scaling reads them
+};
+
 // Functions
-void loadData(const std::string& filename);
-void splitDataset(double trainFraction = 0.8);
+void loadData(const std::string& filename);                 // prompts for the target column
+void loadData(const std::string& filename, int targetCol);
+void loadData(const std::string& filename, int targetCol, const LoadSampling& sampling);
+void splitDataset(double trainFraction = 0.8, uint64_t seed = 42);
+bool loadSparse(const std::string& filename, int targetCol, SparseDataset& out);
+WeightedSet dedupRows(const std::vector<std::vector<double>>& X, const std::vector<int>& y);
 
 #endif